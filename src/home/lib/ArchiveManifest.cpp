@@ -0,0 +1,143 @@
+#include "ArchiveManifest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <ranges>
+#include <thread>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "util/executor/ThreadPool.h"
+
+#include "log.h"
+#include "zip.h"
+
+namespace HomeCompa::FliLib
+{
+
+namespace
+{
+
+constexpr quint32 SIGNATURE = 0x464C414D;
+constexpr quint32 VERSION   = 1;
+
+QString GetCacheFilePath(const QString& filePath)
+{
+	static const QDir dir(QString("%1/HomeCompa/archive-manifests").arg(QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation)));
+	return dir.filePath(QString::fromUtf8(QCryptographicHash::hash(filePath.toUtf8(), QCryptographicHash::Md5).toHex()));
+}
+
+bool Load(const QString& cacheFilePath, ArchiveManifest& manifest)
+{
+	QFile file(cacheFilePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	quint32 signature = 0, version = 0, count = 0;
+	QString filePath;
+	qint64  size = -1, modified = 0;
+
+	QDataStream stream(&file);
+	stream >> signature >> version;
+	if (signature != SIGNATURE || version != VERSION)
+		return false;
+
+	stream >> filePath >> size >> modified >> count;
+	if (stream.status() != QDataStream::Ok || filePath != manifest.filePath || size != manifest.size || modified != manifest.modified)
+		return false;
+
+	std::vector<ArchiveManifestEntry> entries;
+	entries.reserve(std::min(count, quint32 { 1 } << 16));
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+	{
+		auto& entry = entries.emplace_back();
+		stream >> entry.fileName >> entry.size >> entry.time;
+	}
+
+	if (stream.status() != QDataStream::Ok)
+		return false;
+
+	manifest.entries = std::move(entries);
+	return true;
+}
+
+void Save(const QString& cacheFilePath, const ArchiveManifest& manifest)
+{
+	if (const auto dir = QFileInfo(cacheFilePath).dir(); !dir.exists())
+		dir.mkpath(".");
+
+	QSaveFile file(cacheFilePath);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		PLOGW << "archive manifest: cannot write " << cacheFilePath;
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream << SIGNATURE << VERSION << manifest.filePath << manifest.size << manifest.modified << static_cast<quint32>(manifest.entries.size());
+	for (const auto& entry : manifest.entries)
+		stream << entry.fileName << entry.size << entry.time;
+
+	if (stream.status() != QDataStream::Ok || !file.commit())
+		PLOGW << "archive manifest: cannot write " << cacheFilePath;
+}
+
+} // namespace
+
+ArchiveManifest GetArchiveManifest(const QString& filePath)
+{
+	const QFileInfo fileInfo(filePath);
+	ArchiveManifest result { .filePath = fileInfo.absoluteFilePath(), .size = fileInfo.size(), .modified = fileInfo.lastModified().toMSecsSinceEpoch() };
+
+	const auto cacheFilePath = GetCacheFilePath(result.filePath);
+	if (Load(cacheFilePath, result))
+		return result;
+
+	const Zip  zip(result.filePath);
+	const auto fileNames = zip.GetFileNameList();
+	result.entries.reserve(static_cast<size_t>(fileNames.size()));
+	std::ranges::transform(fileNames, std::back_inserter(result.entries), [&](const QString& fileName) {
+		return ArchiveManifestEntry { fileName, static_cast<qint64>(zip.GetFileSize(fileName)), zip.GetFileTime(fileName) };
+	});
+
+	Save(cacheFilePath, result);
+	return result;
+}
+
+size_t GetFileCount(const QStringList& filePaths)
+{
+	std::atomic<size_t> result { 0 };
+	std::exception_ptr  error;
+	std::mutex          errorGuard;
+	{
+		Util::ThreadPool threadPool({ .maxQueueSize = std::thread::hardware_concurrency() });
+		for (const auto& filePath : filePaths)
+			threadPool.enqueue([&](auto) {
+				try
+				{
+					result += GetArchiveManifest(filePath).entries.size();
+				}
+				catch (...)
+				{
+					std::lock_guard lock(errorGuard);
+					if (!error)
+						error = std::current_exception();
+				}
+			});
+		threadPool.wait();
+	}
+
+	if (error)
+		std::rethrow_exception(error);
+
+	return result;
+}
+
+} // namespace HomeCompa::FliLib
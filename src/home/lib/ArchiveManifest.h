@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+
+#include "export/lib.h"
+
+namespace HomeCompa::FliLib
+{
+
+struct ArchiveManifestEntry
+{
+	QString   fileName;
+	qint64    size { 0 };
+	QDateTime time;
+};
+
+struct ArchiveManifest
+{
+	QString                           filePath;
+	qint64                            size { -1 };
+	qint64                            modified { 0 };
+	std::vector<ArchiveManifestEntry> entries;
+};
+
+LIB_EXPORT ArchiveManifest GetArchiveManifest(const QString& filePath);
+LIB_EXPORT size_t          GetFileCount(const QStringList& filePaths);
+
+} // namespace HomeCompa::FliLib
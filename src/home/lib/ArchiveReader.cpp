@@ -0,0 +1,73 @@
+#include "ArchiveReader.h"
+
+#include <algorithm>
+#include <cassert>
+#include <ranges>
+
+namespace HomeCompa::FliLib
+{
+
+ArchiveReader::ArchiveReader(const Zip& zip)
+	: ArchiveReader(zip, zip.GetFileNameList())
+{
+}
+
+ArchiveReader::ArchiveReader(const Zip& zip, const QStringList& fileNames)
+	: m_zip { zip }
+{
+	std::vector<std::pair<size_t, QString>> entries;
+	entries.reserve(static_cast<size_t>(fileNames.size()));
+	std::ranges::transform(fileNames, std::back_inserter(entries), [&](const QString& fileName) {
+		return std::make_pair(static_cast<size_t>(zip.GetFileIndex(fileName)), fileName);
+	});
+	std::ranges::stable_sort(entries, {}, [](const auto& item) {
+		return item.first;
+	});
+
+	m_fileNames.reserve(entries.size());
+	std::ranges::move(entries | std::views::values, std::back_inserter(m_fileNames));
+}
+
+ArchiveReader::~ArchiveReader() = default;
+
+bool ArchiveReader::Next() noexcept
+{
+	if (m_index == m_fileNames.size())
+		return false;
+
+	return ++m_index, true;
+}
+
+size_t ArchiveReader::GetCount() const noexcept
+{
+	return m_fileNames.size();
+}
+
+const QString& ArchiveReader::GetFileName() const noexcept
+{
+	assert(m_index > 0 && m_index <= m_fileNames.size());
+	return m_fileNames[m_index - 1];
+}
+
+size_t ArchiveReader::GetFileSize() const
+{
+	return m_zip.GetFileSize(GetFileName());
+}
+
+QDateTime ArchiveReader::GetFileTime() const
+{
+	return m_zip.GetFileTime(GetFileName());
+}
+
+QByteArray ArchiveReader::Read() const
+{
+	return m_zip.Read(GetFileName())->GetStream().readAll();
+}
+
+void ForEachEntry(const Zip& zip, const OnArchiveEntry& callback)
+{
+	for (ArchiveReader reader(zip); reader.Next();)
+		callback(reader.GetFileName(), reader.Read(), reader.GetFileTime());
+}
+
+} // namespace HomeCompa::FliLib
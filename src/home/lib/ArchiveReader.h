@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+#include <QStringList>
+
+#include "fnd/NonCopyMovable.h"
+
+#include "zip.h"
+
+#include "export/lib.h"
+
+namespace HomeCompa::FliLib
+{
+
+// Walks zip entries in archive index order. Every entry is still extracted by its own Zip::Read call:
+// the Zip wrapper has no single-pass extraction, the order only keeps solid blocks from being rewound backwards.
+class LIB_EXPORT ArchiveReader
+{
+	NON_COPY_MOVABLE(ArchiveReader)
+
+public:
+	explicit ArchiveReader(const Zip& zip);
+	ArchiveReader(const Zip& zip, const QStringList& fileNames);
+	~ArchiveReader();
+
+public:
+	bool           Next() noexcept;
+	size_t         GetCount() const noexcept;
+	const QString& GetFileName() const noexcept;
+	size_t         GetFileSize() const;
+	QDateTime      GetFileTime() const;
+	QByteArray     Read() const;
+
+private:
+	const Zip&           m_zip;
+	std::vector<QString> m_fileNames;
+	size_t               m_index { 0 };
+};
+
+using OnArchiveEntry = std::function<void(QString fileName, QByteArray body, QDateTime time)>;
+LIB_EXPORT void ForEachEntry(const Zip& zip, const OnArchiveEntry& callback);
+
+} // namespace HomeCompa::FliLib
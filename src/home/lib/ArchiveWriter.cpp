@@ -0,0 +1,129 @@
+#include "ArchiveWriter.h"
+
+#include <array>
+#include <cassert>
+#include <cmath>
+
+namespace HomeCompa::FliLib
+{
+
+namespace
+{
+
+constexpr qsizetype SAMPLE_SIZE            = 4096;
+constexpr qsizetype SAMPLE_COUNT           = 4;
+constexpr double    INCOMPRESSIBLE_ENTROPY = 7.5;
+
+bool HasHighEntropy(const QByteArray& body) noexcept
+{
+	std::array<qsizetype, 256> histogram {};
+	qsizetype                  total = 0;
+
+	const auto addSample = [&](const qsizetype offset, const qsizetype size) {
+		for (const auto byte : QByteArrayView(body).sliced(offset, size))
+			++histogram[static_cast<uint8_t>(byte)];
+		total += size;
+	};
+
+	if (body.size() <= SAMPLE_SIZE * SAMPLE_COUNT)
+		addSample(0, body.size());
+	else
+		for (qsizetype i = 0; i < SAMPLE_COUNT; ++i)
+			addSample((body.size() - SAMPLE_SIZE) * i / (SAMPLE_COUNT - 1), SAMPLE_SIZE);
+
+	if (total == 0)
+		return false;
+
+	double entropy = 0;
+	for (const auto count : histogram)
+	{
+		if (count == 0)
+			continue;
+
+		const auto probability  = static_cast<double>(count) / static_cast<double>(total);
+		entropy                -= probability * std::log2(probability);
+	}
+
+	return entropy > INCOMPRESSIBLE_ENTROPY;
+}
+
+} // namespace
+
+ArchiveWriter::ArchiveWriter(const QString& filePath, const Zip::Format format, const bool adaptiveCompression)
+	: m_filePath { filePath }
+	, m_format { format }
+	, m_adaptiveCompression { adaptiveCompression }
+	, m_files { Zip::CreateZipFileController() }
+{
+}
+
+ArchiveWriter::ArchiveWriter(QIODevice& stream, const Zip::Format format, const bool adaptiveCompression)
+	: m_stream { &stream }
+	, m_format { format }
+	, m_adaptiveCompression { adaptiveCompression }
+	, m_files { Zip::CreateZipFileController() }
+{
+}
+
+ArchiveWriter::~ArchiveWriter() = default;
+
+ArchiveWriter& ArchiveWriter::SetProperty(const Zip::PropertyId id, const QVariant& value)
+{
+	m_properties.emplace_back(id, value);
+	return *this;
+}
+
+void ArchiveWriter::Append(QString fileName, QByteArray body)
+{
+	assert(m_files);
+	AddSize(body);
+	m_files->AddFile(std::move(fileName), std::move(body));
+}
+
+void ArchiveWriter::Append(QString fileName, QByteArray body, QDateTime time)
+{
+	assert(m_files);
+	AddSize(body);
+	m_files->AddFile(std::move(fileName), std::move(body), std::move(time));
+}
+
+size_t ArchiveWriter::GetCount() const
+{
+	return m_files ? m_files->GetCount() : 0;
+}
+
+qint64 ArchiveWriter::GetSize() const noexcept
+{
+	return m_size;
+}
+
+qint64 ArchiveWriter::GetIncompressibleSize() const noexcept
+{
+	return m_incompressibleSize;
+}
+
+bool ArchiveWriter::IsIncompressible() const noexcept
+{
+	return m_size > 0 && m_incompressibleSize * 10 >= m_size * 9;
+}
+
+bool ArchiveWriter::Finalize()
+{
+	assert(m_files);
+	const auto files = std::move(m_files);
+
+	const auto zip = m_stream ? std::make_unique<Zip>(*m_stream, m_format) : std::make_unique<Zip>(m_filePath, m_format);
+	for (const auto& [id, value] : m_properties)
+		zip->SetProperty(id, value);
+
+	return zip->Write(*files);
+}
+
+void ArchiveWriter::AddSize(const QByteArray& body) noexcept
+{
+	m_size += body.size();
+	if (m_adaptiveCompression && HasHighEntropy(body))
+		m_incompressibleSize += body.size();
+}
+
+} // namespace HomeCompa::FliLib
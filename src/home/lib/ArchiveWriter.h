@@ -0,0 +1,58 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QString>
+#include <QVariant>
+
+#include "fnd/NonCopyMovable.h"
+
+#include "zip.h"
+
+#include "export/lib.h"
+
+class QIODevice;
+
+namespace HomeCompa::FliLib
+{
+
+// Collects entries and writes them with a single Zip::Write in Finalize: the Zip wrapper has no streaming write.
+// The archive itself is not created before Finalize, so nothing is left on disk for an archive that is never finalized.
+class LIB_EXPORT ArchiveWriter
+{
+	NON_COPY_MOVABLE(ArchiveWriter)
+
+public:
+	// with adaptiveCompression every appended body is sampled for IsIncompressible, otherwise nothing is sampled and it returns false
+	ArchiveWriter(const QString& filePath, Zip::Format format, bool adaptiveCompression = false);
+	ArchiveWriter(QIODevice& stream, Zip::Format format, bool adaptiveCompression = false);
+	~ArchiveWriter();
+
+public:
+	ArchiveWriter& SetProperty(Zip::PropertyId id, const QVariant& value);
+	void           Append(QString fileName, QByteArray body);
+	void           Append(QString fileName, QByteArray body, QDateTime time);
+	size_t         GetCount() const;
+	qint64         GetSize() const noexcept;
+	qint64         GetIncompressibleSize() const noexcept;
+	bool           IsIncompressible() const noexcept;
+	bool           Finalize();
+
+private:
+	void AddSize(const QByteArray& body) noexcept;
+
+private:
+	const QString                                     m_filePath;
+	QIODevice*                                        m_stream { nullptr };
+	const Zip::Format                                 m_format;
+	const bool                                        m_adaptiveCompression;
+	std::vector<std::pair<Zip::PropertyId, QVariant>> m_properties;
+	std::shared_ptr<IZipFileController>               m_files;
+	qint64                                            m_size { 0 };
+	qint64                                            m_incompressibleSize { 0 };
+};
+
+} // namespace HomeCompa::FliLib
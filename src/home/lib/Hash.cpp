@@ -0,0 +1,124 @@
+#include "Hash.h"
+
+#include <format>
+#include <stdexcept>
+
+#include <QCryptographicHash>
+#include <QRegularExpression>
+
+#include <boost/hash2/xxh3.hpp>
+
+namespace HomeCompa::FliLib
+{
+
+class Hash::Impl // NOLINT(cppcoreguidelines-special-member-functions)
+{
+public:
+	virtual ~Impl() = default;
+
+	virtual void       Reset()                      = 0;
+	virtual void       AddData(QByteArrayView data) = 0;
+	virtual QByteArray Result()                     = 0;
+};
+
+namespace
+{
+
+class Md5 final : public Hash::Impl
+{
+private: // Hash::Impl
+	void Reset() override
+	{
+		m_hash.reset();
+	}
+
+	void AddData(const QByteArrayView data) override
+	{
+		m_hash.addData(data);
+	}
+
+	QByteArray Result() override
+	{
+		return m_hash.result();
+	}
+
+private:
+	QCryptographicHash m_hash { QCryptographicHash::Md5 };
+};
+
+class Xxh3 final : public Hash::Impl
+{
+private: // Hash::Impl
+	void Reset() override
+	{
+		m_hash = {};
+	}
+
+	void AddData(const QByteArrayView data) override
+	{
+		m_hash.update(data.data(), static_cast<size_t>(data.size()));
+	}
+
+	QByteArray Result() override
+	{
+		const auto digest = m_hash.result();
+		return QByteArray(reinterpret_cast<const char*>(digest.data()), static_cast<qsizetype>(digest.size()));
+	}
+
+private:
+	boost::hash2::xxh3_128 m_hash;
+};
+
+std::unique_ptr<Hash::Impl> CreateImpl(const QString& algorithm)
+{
+	if (algorithm == HASH_MD5)
+		return std::make_unique<Md5>();
+	if (algorithm == HASH_XXH3)
+		return std::make_unique<Xxh3>();
+
+	throw std::invalid_argument(std::format("unknown hash algorithm {}, must be {}", algorithm.toStdString(), Hash::GetAlgorithms().join(" | ").toStdString()));
+}
+
+} // namespace
+
+QStringList Hash::GetAlgorithms()
+{
+	return { HASH_MD5, HASH_XXH3 };
+}
+
+Hash::Hash(const QString& algorithm)
+	: m_algorithm { algorithm }
+	, m_impl { CreateImpl(algorithm) }
+{
+}
+
+Hash::~Hash() = default;
+
+const QString& Hash::GetAlgorithm() const noexcept
+{
+	return m_algorithm;
+}
+
+void Hash::Reset()
+{
+	m_impl->Reset();
+}
+
+void Hash::AddData(const QByteArrayView data)
+{
+	m_impl->AddData(data);
+}
+
+QByteArray Hash::Result()
+{
+	return m_impl->Result();
+}
+
+QString GetHashAlgorithm(const QByteArrayView hashXmlHead)
+{
+	static const QRegularExpression rx(QString(R"(<books\b[^>]*\b%1="([^"]+)")").arg(HASH_ALGORITHM));
+	const auto                      match = rx.match(QString::fromUtf8(hashXmlHead));
+	return match.hasMatch() ? match.captured(1) : QString { HASH_MD5 };
+}
+
+} // namespace HomeCompa::FliLib
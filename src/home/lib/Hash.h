@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "fnd/NonCopyMovable.h"
+
+#include "export/lib.h"
+
+namespace HomeCompa::FliLib
+{
+
+constexpr auto HASH_ALGORITHM = "hashAlgorithm";
+constexpr auto HASH_MD5       = "md5";
+constexpr auto HASH_XXH3      = "xxh3";
+
+class LIB_EXPORT Hash
+{
+	NON_COPY_MOVABLE(Hash)
+
+public:
+	static QStringList GetAlgorithms();
+
+public:
+	explicit Hash(const QString& algorithm = HASH_MD5);
+	~Hash();
+
+public:
+	const QString& GetAlgorithm() const noexcept;
+	void           Reset();
+	void           AddData(QByteArrayView data);
+	QByteArray     Result();
+
+	class Impl;
+
+private:
+	const QString         m_algorithm;
+	std::unique_ptr<Impl> m_impl;
+};
+
+LIB_EXPORT QString GetHashAlgorithm(QByteArrayView hashXmlHead);
+
+} // namespace HomeCompa::FliLib
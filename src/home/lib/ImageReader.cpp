@@ -0,0 +1,32 @@
+#include "ImageReader.h"
+
+#include <QImageIOHandler>
+#include <QImageReader>
+
+namespace HomeCompa::FliLib
+{
+
+QSize SetScaledSize(QImageReader& reader, const QSize& maxSize)
+{
+	const auto size = reader.size();
+	if (!size.isValid() || !maxSize.isValid() || (size.width() <= maxSize.width() && size.height() <= maxSize.height()))
+		return size;
+
+	if (!reader.supportsOption(QImageIOHandler::ScaledSize))
+		return size;
+
+	const auto fitted = size.scaled(maxSize, Qt::KeepAspectRatio);
+	if (fitted.isEmpty())
+		return size;
+
+	int factor = 1;
+	while (size.width() / (factor * 2) >= fitted.width() && size.height() / (factor * 2) >= fitted.height())
+		factor *= 2;
+
+	if (factor > 1)
+		reader.setScaledSize(fitted * factor);
+
+	return size;
+}
+
+} // namespace HomeCompa::FliLib
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <QSize>
+
+#include "export/lib.h"
+
+class QImageReader;
+
+namespace HomeCompa::FliLib
+{
+
+LIB_EXPORT QSize SetScaledSize(QImageReader& reader, const QSize& maxSize);
+
+}
@@ -0,0 +1,111 @@
+#include "ImageStatisticsDatabase.h"
+
+#include <format>
+#include <stdexcept>
+
+#include <QFile>
+
+#include "database/interface/ICommand.h"
+#include "database/interface/IDatabase.h"
+#include "database/interface/IQuery.h"
+#include "database/interface/ITransaction.h"
+
+#include "database/factory/Factory.h"
+
+#include "Hash.h"
+#include "log.h"
+
+namespace HomeCompa::FliLib
+{
+
+namespace
+{
+
+void Execute(DB::IDatabase& db, const std::initializer_list<const char*> commands)
+{
+	const auto tr = db.CreateTransaction();
+	for (const auto* command : commands)
+		tr->CreateCommand(command)->Execute();
+	tr->Commit();
+}
+
+void CreateDatabaseSchema(DB::IDatabase& db)
+{
+	Execute(
+		db,
+		{
+			R"(
+CREATE TABLE IF NOT EXISTS Image (
+    Folder    VARCHAR (200) NOT NULL,
+    FileName  VARCHAR (255) NOT NULL,
+    ImageID   VARCHAR (255) NOT NULL,
+    FailInfo  VARCHAR (20),
+    IsCover   INTEGER       NOT NULL,
+    PixelType INTEGER,
+    Size      BIGINT,
+    Width     INTEGER,
+    Height    INTEGER,
+    Hash      VARCHAR (50)  NOT NULL
+)
+)",
+			"CREATE INDEX IF NOT EXISTS IX_Image_Folder ON Image (Folder)",
+			"CREATE TABLE IF NOT EXISTS Metadata (Name VARCHAR (50) NOT NULL PRIMARY KEY, Value VARCHAR (200))",
+		}
+	);
+}
+
+void CheckHashAlgorithm(DB::IDatabase& db, const QString& hashAlgorithm)
+{
+	const auto check = [&](const QString& stored) {
+		if (stored != hashAlgorithm)
+			throw std::invalid_argument(std::format("database hash algorithm {} does not match statistics hash algorithm {}", stored.toStdString(), hashAlgorithm.toStdString()));
+	};
+
+	{
+		const auto query = db.CreateQuery("select Value from Metadata where Name = 'HashAlgorithm'");
+		query->Execute();
+		if (!query->Eof())
+			return check(query->Get<const char*>(0));
+	}
+
+	{
+		// rows written before the hash algorithm was stored are md5
+		const auto query = db.CreateQuery("select exists (select 42 from Image)");
+		query->Execute();
+		if (!query->Eof() && query->Get<int>(0))
+			check(HASH_MD5);
+	}
+
+	const auto tr      = db.CreateTransaction();
+	const auto command = tr->CreateCommand("INSERT INTO Metadata (Name, Value) VALUES ('HashAlgorithm', ?)");
+	command->Bind(0, hashAlgorithm.toStdString());
+	command->Execute();
+	tr->Commit();
+}
+
+} // namespace
+
+std::unique_ptr<DB::IDatabase> CreateImageStatisticsDatabase(const QString& fileName, const QString& hashAlgorithm)
+{
+	const auto dbExists     = QFile::exists(fileName);
+	const auto dbParameters = std::format("path={};flag={}", fileName.toStdString(), dbExists ? "READWRITE" : "CREATE");
+	auto       db           = Create(DB::Factory::Impl::Sqlite, dbParameters);
+	CreateDatabaseSchema(*db);
+	CheckHashAlgorithm(*db, hashAlgorithm);
+	PLOGI << "image statistics database: " << fileName.toStdString() << ", hash algorithm: " << hashAlgorithm.toStdString();
+	return db;
+}
+
+void CreateImageStatisticsIndices(DB::IDatabase& db)
+{
+	PLOGI << "image statistics database: creating indices";
+	Execute(
+		db,
+		{
+			"CREATE INDEX IF NOT EXISTS IX_Image_Hash ON Image (Hash)",
+			"CREATE INDEX IF NOT EXISTS IX_Image_FileName ON Image (FileName)",
+		}
+	);
+}
+
+} // namespace HomeCompa::FliLib
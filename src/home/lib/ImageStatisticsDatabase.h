@@ -0,0 +1,25 @@
+#pragma once
+
+#include <memory>
+
+#include <QString>
+
+#include "export/lib.h"
+
+namespace HomeCompa::DB
+{
+
+class IDatabase;
+
+}
+
+namespace HomeCompa::FliLib
+{
+
+constexpr auto INSERT_IMAGE_STATISTICS = "INSERT INTO Image (Folder, FileName, ImageID, FailInfo, IsCover, PixelType, Size, Width, Height, Hash) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)";
+constexpr auto DELETE_IMAGE_STATISTICS = "DELETE FROM Image WHERE Folder = ?";
+
+LIB_EXPORT std::unique_ptr<DB::IDatabase> CreateImageStatisticsDatabase(const QString& fileName, const QString& hashAlgorithm);
+LIB_EXPORT void                           CreateImageStatisticsIndices(DB::IDatabase& db);
+
+} // namespace HomeCompa::FliLib
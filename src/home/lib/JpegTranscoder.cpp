@@ -0,0 +1,65 @@
+#include "JpegTranscoder.h"
+
+#include <algorithm>
+
+#include <jxl/encode_cxx.h>
+
+#include "log.h"
+
+namespace HomeCompa::FliLib
+{
+
+namespace
+{
+
+constexpr size_t MIN_OUTPUT_SIZE = 64 * 1024;
+
+}
+
+bool IsJpeg(const QByteArray& body) noexcept
+{
+	return body.startsWith("\xFF\xD8\xFF");
+}
+
+QByteArray TranscodeJpeg(const QByteArray& jpeg)
+{
+	const auto encoder = JxlEncoderMake(nullptr);
+	if (!encoder)
+		return {};
+
+	if (JxlEncoderUseContainer(encoder.get(), JXL_TRUE) != JXL_ENC_SUCCESS || JxlEncoderStoreJPEGMetadata(encoder.get(), JXL_TRUE) != JXL_ENC_SUCCESS)
+		return {};
+
+	auto* frameSettings = JxlEncoderFrameSettingsCreate(encoder.get(), nullptr);
+	if (!frameSettings || JxlEncoderAddJPEGFrame(frameSettings, reinterpret_cast<const uint8_t*>(jpeg.constData()), static_cast<size_t>(jpeg.size())) != JXL_ENC_SUCCESS)
+	{
+		PLOGD << "jpeg transcoding failed: " << static_cast<int>(JxlEncoderGetError(encoder.get()));
+		return {};
+	}
+	JxlEncoderCloseInput(encoder.get());
+
+	QByteArray result(static_cast<qsizetype>(std::max(MIN_OUTPUT_SIZE, static_cast<size_t>(jpeg.size()))), Qt::Uninitialized);
+	auto*      next      = reinterpret_cast<uint8_t*>(result.data());
+	auto       available = static_cast<size_t>(result.size());
+
+	auto status = JxlEncoderProcessOutput(encoder.get(), &next, &available);
+	while (status == JXL_ENC_NEED_MORE_OUTPUT)
+	{
+		const auto offset = next - reinterpret_cast<uint8_t*>(result.data());
+		result.resize(result.size() * 2);
+		next      = reinterpret_cast<uint8_t*>(result.data()) + offset;
+		available = static_cast<size_t>(result.size() - offset);
+		status    = JxlEncoderProcessOutput(encoder.get(), &next, &available);
+	}
+
+	if (status != JXL_ENC_SUCCESS)
+	{
+		PLOGD << "jpeg transcoding failed: " << static_cast<int>(JxlEncoderGetError(encoder.get()));
+		return {};
+	}
+
+	result.resize(next - reinterpret_cast<uint8_t*>(result.data()));
+	return result;
+}
+
+} // namespace HomeCompa::FliLib
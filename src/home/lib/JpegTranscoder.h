@@ -0,0 +1,13 @@
+#pragma once
+
+#include <QByteArray>
+
+#include "export/lib.h"
+
+namespace HomeCompa::FliLib
+{
+
+LIB_EXPORT bool       IsJpeg(const QByteArray& body) noexcept;
+LIB_EXPORT QByteArray TranscodeJpeg(const QByteArray& jpeg);
+
+}
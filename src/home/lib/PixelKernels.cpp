@@ -0,0 +1,245 @@
+#include "PixelKernels.h"
+
+#include <cstdint>
+#include <cstring>
+
+#include <QImage>
+
+#include "Hash.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define PIXEL_KERNELS_TARGET(ISA)
+#else
+#define PIXEL_KERNELS_TARGET(ISA) __attribute__((target(ISA)))
+#endif
+#endif
+
+namespace HomeCompa::FliLib
+{
+
+namespace
+{
+
+// BT.709 luma weights scaled to 128, shared by all code paths so they produce identical results
+constexpr int GRAY_R = 27;
+constexpr int GRAY_G = 92;
+constexpr int GRAY_B = 9;
+static_assert(GRAY_R + GRAY_G + GRAY_B == 128);
+
+enum class Isa
+{
+	Scalar,
+	Sse4,
+	Avx2,
+};
+
+constexpr const char* ISA_NAMES[] { "scalar", "sse4.1", "avx2" };
+
+void ToGrayscaleScalar(const uint8_t* src, uint8_t* dst, const int width)
+{
+	for (int i = 0; i < width; ++i, src += 4)
+		dst[i] = static_cast<uint8_t>((src[0] * GRAY_B + src[1] * GRAY_G + src[2] * GRAY_R + 64) >> 7);
+}
+
+bool IsOpaqueScalar(const uint8_t* src, const int width)
+{
+	for (int i = 0; i < width; ++i, src += 4)
+		if (src[3] != 0xFF)
+			return false;
+	return true;
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+Isa DetectIsa()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4] {};
+	__cpuid(info, 0);
+	const auto maxLeaf = info[0];
+
+	__cpuid(info, 1);
+	const bool sse4    = (info[2] & (1 << 19)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx     = (info[2] & (1 << 28)) != 0 && osxsave && (_xgetbv(0) & 0x6) == 0x6;
+
+	bool avx2 = false;
+	if (maxLeaf >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = avx && (info[1] & (1 << 5)) != 0;
+	}
+
+	return avx2 ? Isa::Avx2 : sse4 ? Isa::Sse4 : Isa::Scalar;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") ? Isa::Avx2 : __builtin_cpu_supports("sse4.1") ? Isa::Sse4 : Isa::Scalar;
+#endif
+}
+
+PIXEL_KERNELS_TARGET("sse4.1")
+void ToGrayscaleSse4(const uint8_t* src, uint8_t* dst, const int width)
+{
+	const auto weights = _mm_setr_epi8(GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0);
+	const auto ones    = _mm_set1_epi16(1);
+	const auto half    = _mm_set1_epi32(64);
+
+	int i = 0;
+	for (; i + 8 <= width; i += 8, src += 32, dst += 8)
+	{
+		const auto lo = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), weights), ones), half), 7);
+		const auto hi = _mm_srli_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), weights), ones), half), 7);
+		const auto packed = _mm_packs_epi32(lo, hi);
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(packed, packed));
+	}
+
+	ToGrayscaleScalar(src, dst, width - i);
+}
+
+PIXEL_KERNELS_TARGET("avx2")
+void ToGrayscaleAvx2(const uint8_t* src, uint8_t* dst, const int width)
+{
+	const auto weights = _mm256_setr_epi8(
+		GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0,
+		GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0, GRAY_B, GRAY_G, GRAY_R, 0
+	);
+	const auto ones  = _mm256_set1_epi16(1);
+	const auto half  = _mm256_set1_epi32(64);
+	const auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	int i = 0;
+	for (; i + 16 <= width; i += 16, src += 64, dst += 16)
+	{
+		const auto lo = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)), weights), ones), half), 7);
+		const auto hi = _mm256_srli_epi32(_mm256_add_epi32(_mm256_madd_epi16(_mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 32)), weights), ones), half), 7);
+		const auto packed = _mm256_packs_epi32(lo, hi);
+		const auto bytes  = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(packed, packed), order);
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(bytes));
+	}
+
+	ToGrayscaleSse4(src, dst, width - i);
+}
+
+PIXEL_KERNELS_TARGET("sse4.1")
+bool IsOpaqueSse4(const uint8_t* src, const int width)
+{
+	const auto alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+	auto acc = _mm_set1_epi32(-1);
+	int  i   = 0;
+	for (; i + 4 <= width; i += 4, src += 16)
+		acc = _mm_and_si128(acc, _mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+
+	return _mm_test_all_ones(_mm_or_si128(acc, _mm_xor_si128(alpha, _mm_set1_epi32(-1)))) && IsOpaqueScalar(src, width - i);
+}
+
+PIXEL_KERNELS_TARGET("avx2")
+bool IsOpaqueAvx2(const uint8_t* src, const int width)
+{
+	const auto alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+
+	auto acc = _mm256_set1_epi32(-1);
+	int  i   = 0;
+	for (; i + 8 <= width; i += 8, src += 32)
+		acc = _mm256_and_si256(acc, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src)));
+
+	return _mm256_testc_si256(acc, alpha) && IsOpaqueSse4(src, width - i);
+}
+
+#else
+
+Isa DetectIsa()
+{
+	return Isa::Scalar;
+}
+
+#endif
+
+Isa GetIsa()
+{
+	static const auto isa = DetectIsa();
+	return isa;
+}
+
+void ToGrayscale(const uint8_t* src, uint8_t* dst, const int width)
+{
+#ifdef PIXEL_KERNELS_X86
+	switch (GetIsa())
+	{
+		case Isa::Avx2:
+			return ToGrayscaleAvx2(src, dst, width);
+		case Isa::Sse4:
+			return ToGrayscaleSse4(src, dst, width);
+		case Isa::Scalar:
+			break;
+	}
+#endif
+	ToGrayscaleScalar(src, dst, width);
+}
+
+bool IsOpaque(const uint8_t* src, const int width)
+{
+#ifdef PIXEL_KERNELS_X86
+	switch (GetIsa())
+	{
+		case Isa::Avx2:
+			return IsOpaqueAvx2(src, width);
+		case Isa::Sse4:
+			return IsOpaqueSse4(src, width);
+		case Isa::Scalar:
+			break;
+	}
+#endif
+	return IsOpaqueScalar(src, width);
+}
+
+} // namespace
+
+const char* GetPixelKernelsIsa()
+{
+	return ISA_NAMES[static_cast<int>(GetIsa())];
+}
+
+QImage ToGrayscale(QImage image)
+{
+	if (!(image.format() == QImage::Format_RGB32 || image.format() == QImage::Format_ARGB32))
+	{
+		image.convertTo(QImage::Format_Grayscale8);
+		return image;
+	}
+
+	QImage result(image.size(), QImage::Format_Grayscale8);
+	for (int h = 0, height = image.height(); h < height; ++h)
+		ToGrayscale(image.constScanLine(h), result.scanLine(h), image.width());
+
+	return result;
+}
+
+QImage DropOpaqueAlpha(QImage image)
+{
+	if (!(image.format() == QImage::Format_ARGB32 || image.format() == QImage::Format_ARGB32_Premultiplied))
+		return image;
+
+	for (int h = 0, height = image.height(); h < height; ++h)
+		if (!IsOpaque(image.constScanLine(h), image.width()))
+			return image;
+
+	image.convertTo(QImage::Format_RGB32);
+	return image;
+}
+
+void AddPixelData(Hash& hash, const QImage& image, const int channelCount)
+{
+	const auto rowSize = static_cast<qsizetype>(image.width()) * channelCount;
+	if (rowSize == image.bytesPerLine())
+		return hash.AddData(QByteArrayView { reinterpret_cast<const char*>(image.constBits()), rowSize * image.height() });
+
+	for (int h = 0, height = image.height(); h < height; ++h)
+		hash.AddData(QByteArrayView { reinterpret_cast<const char*>(image.constScanLine(h)), rowSize });
+}
+
+} // namespace HomeCompa::FliLib
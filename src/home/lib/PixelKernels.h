@@ -0,0 +1,25 @@
+#pragma once
+
+#include "export/lib.h"
+
+class QImage;
+
+namespace HomeCompa::FliLib
+{
+
+class Hash;
+
+// Scanline kernels for the image hot path, measured against their Qt baselines by flibench.
+// Resizing is not covered: QImage::scaled stays in use because its smooth filter cannot be matched bit for bit.
+
+LIB_EXPORT const char* GetPixelKernelsIsa();
+
+// BT.709 luma computed on gamma-encoded values for RGB32 and ARGB32, other formats use QImage::convertTo.
+// Qt 6 converts to Grayscale8 in linear light, so levels differ (flibench reports by how much)
+// and pixel hashes of grayscale images are not comparable with the ones made by QImage::convertTo.
+LIB_EXPORT QImage ToGrayscale(QImage image);
+
+LIB_EXPORT QImage DropOpaqueAlpha(QImage image);
+LIB_EXPORT void   AddPixelData(Hash& hash, const QImage& image, int channelCount);
+
+}
@@ -1,6 +1,8 @@
 #include "UniqueFile.h"
 
+#include <algorithm>
 #include <ranges>
+#include <stdexcept>
 #include <unordered_set>
 
 #include <QBuffer>
@@ -15,6 +17,7 @@
 #include "util/progress.h"
 #include "util/xml/XmlWriter.h"
 
+#include "Hash.h"
 #include "book.h"
 #include "log.h"
 #include "util.h"
@@ -381,6 +384,7 @@ UniqueFileStorage::UniqueFileStorage(QString dstDir, const int hammingThreshold,
 	Util::ThreadPool<HashParserObserver> threadPool({ .maxQueueSize = static_cast<size_t>(std::thread::hardware_concurrency()) * 2, .contextGetter = [](auto) {
 														 return HashParserObserver {};
 													 } });
+	std::set<QString> hashAlgorithms;
 	{
 		Util::Progress progress(static_cast<size_t>(xmlList.size()), "parsing");
 		for (const auto& xml : xmlList)
@@ -389,7 +393,10 @@ UniqueFileStorage::UniqueFileStorage(QString dstDir, const int hammingThreshold,
 			if (!file.open(QIODevice::ReadOnly))
 				continue;
 
-			threadPool.enqueue([&, xml, bytes = file.readAll()](HashParserObserver& observer) mutable {
+			auto bytes = file.readAll();
+			hashAlgorithms.insert(FliLib::GetHashAlgorithm(QByteArrayView(bytes).first(std::min(bytes.size(), qsizetype { 1024 }))));
+
+			threadPool.enqueue([&, xml, bytes = std::move(bytes)](HashParserObserver& observer) mutable {
 				QBuffer buffer(&bytes);
 				buffer.open(QIODevice::ReadOnly);
 				Util::HashParser::Parse(buffer, observer);
@@ -399,6 +406,10 @@ UniqueFileStorage::UniqueFileStorage(QString dstDir, const int hammingThreshold,
 	}
 
 	auto observers = threadPool.wait();
+
+	if (hashAlgorithms.size() > 1)
+		throw std::invalid_argument(QString("hash files in %1 use different hash algorithms: %2").arg(m_hashDir, QStringList { hashAlgorithms.cbegin(), hashAlgorithms.cend() }.join(", ")).toStdString());
+
 	erase_if(observers, [](const auto& item) {
 		return item.data.empty();
 	});
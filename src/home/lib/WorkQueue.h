@@ -0,0 +1,195 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+
+#include "fnd/NonCopyMovable.h"
+
+namespace HomeCompa::FliLib
+{
+
+// Bounded lock-free MPMC queue (Vyukov's ring of sequenced cells) with blocking Push, Pop and WaitUntil on top.
+// Waiting threads sleep in std::atomic::wait on event counters: a push wakes a single consumer, a pop or NotifyChanged wakes every
+// WaitUntil caller since their predicates may differ.
+template <typename T>
+class WorkQueue
+{
+	NON_COPY_MOVABLE(WorkQueue)
+
+	static constexpr size_t CACHE_LINE_SIZE = 64;
+
+	struct Cell
+	{
+		std::atomic<size_t> sequence { 0 };
+		std::optional<T>    value;
+	};
+
+public:
+	explicit WorkQueue(const size_t capacity)
+		: m_mask { std::bit_ceil(std::max<size_t>(capacity, 2)) - 1 }
+		, m_cells { std::make_unique<Cell[]>(m_mask + 1) }
+	{
+		for (size_t i = 0; i <= m_mask; ++i)
+			m_cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	~WorkQueue() = default;
+
+public:
+	size_t GetCapacity() const noexcept
+	{
+		return m_mask + 1;
+	}
+
+	size_t GetSize() const noexcept
+	{
+		return m_size;
+	}
+
+	bool TryPush(T& item)
+	{
+		auto  position = m_pushPosition.load(std::memory_order_relaxed);
+		Cell* cell     = nullptr;
+		while (true)
+		{
+			cell                = &m_cells[position & m_mask];
+			const auto sequence = cell->sequence.load(std::memory_order_acquire);
+			if (const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position); diff == 0)
+			{
+				if (m_pushPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = m_pushPosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->value.emplace(std::move(item));
+		cell->sequence.store(position + 1, std::memory_order_release);
+		++m_size;
+
+		++m_pushEvents;
+		if (m_popWaiters > 0)
+			m_pushEvents.notify_one();
+
+		return true;
+	}
+
+	std::optional<T> TryPop()
+	{
+		auto  position = m_popPosition.load(std::memory_order_relaxed);
+		Cell* cell     = nullptr;
+		while (true)
+		{
+			cell                = &m_cells[position & m_mask];
+			const auto sequence = cell->sequence.load(std::memory_order_acquire);
+			if (const auto diff = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1); diff == 0)
+			{
+				if (m_popPosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				return std::nullopt;
+			}
+			else
+			{
+				position = m_popPosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		auto item = std::move(cell->value);
+		cell->value.reset();
+		cell->sequence.store(position + m_mask + 1, std::memory_order_release);
+		--m_size;
+
+		NotifyChanged();
+		return item;
+	}
+
+	void Push(T item)
+	{
+		while (!TryPush(item))
+			WaitUntil([this] {
+				return m_size < GetCapacity();
+			});
+	}
+
+	std::optional<T> Pop()
+	{
+		while (true)
+		{
+			if (auto item = TryPop())
+				return item;
+
+			++m_popWaiters;
+			const auto events = m_pushEvents.load();
+			auto       item   = TryPop();
+			if (!item && !m_closed)
+				m_pushEvents.wait(events);
+			--m_popWaiters;
+
+			if (item)
+				return item;
+
+			if (m_closed)
+				return TryPop();
+		}
+	}
+
+	void Close()
+	{
+		m_closed = true;
+		++m_pushEvents;
+		m_pushEvents.notify_all();
+	}
+
+	template <typename Predicate>
+	void WaitUntil(Predicate predicate)
+	{
+		++m_changeWaiters;
+		while (true)
+		{
+			const auto events = m_changeEvents.load();
+			if (predicate())
+				break;
+
+			m_changeEvents.wait(events);
+		}
+		--m_changeWaiters;
+	}
+
+	void NotifyChanged()
+	{
+		++m_changeEvents;
+		if (m_changeWaiters > 0)
+			m_changeEvents.notify_all();
+	}
+
+private:
+	const size_t            m_mask;
+	std::unique_ptr<Cell[]> m_cells;
+
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_pushPosition { 0 };
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_popPosition { 0 };
+	alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_size { 0 };
+
+	std::atomic<uint32_t> m_pushEvents { 0 };
+	std::atomic<uint32_t> m_changeEvents { 0 };
+	std::atomic_int       m_popWaiters { 0 };
+	std::atomic_int       m_changeWaiters { 0 };
+	std::atomic_bool      m_closed { false };
+};
+
+} // namespace HomeCompa::FliLib
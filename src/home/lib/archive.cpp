@@ -11,9 +11,9 @@
 
 #include "util/files.h"
 
+#include "ArchiveManifest.h"
 #include "log.h"
 #include "util.h"
-#include "zip.h"
 
 namespace HomeCompa::FliLib
 {
@@ -77,10 +77,9 @@ Archives GetArchives(const QStringList& wildCards)
 size_t Total(const Archives& archives)
 {
 	PLOGD << "Total file count calculation";
-	const auto totalFileCount = std::accumulate(archives.cbegin(), archives.cend(), 0ULL, [](const auto init, const auto& archive) {
-		const Zip zip(archive.filePath);
-		return init + static_cast<size_t>(zip.GetFileNameList().size());
-	});
+	const auto totalFileCount = GetFileCount(archives | std::views::transform([](const auto& archive) {
+												 return archive.filePath;
+											 }) | std::ranges::to<QStringList>());
 	PLOGI << "Total file count: " << totalFileCount;
 
 	return totalFileCount;
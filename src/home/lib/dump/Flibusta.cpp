@@ -10,6 +10,7 @@
 #include "database/interface/IDatabase.h"
 #include "database/interface/IQuery.h"
 
+#include "lib/ArchiveWriter.h"
 #include "util/executor/ThreadPool.h"
 #include "util/language.h"
 
@@ -230,13 +231,6 @@ std::vector<std::tuple<int, QByteArray, QByteArray>> CreateAuthorAnnotationsData
 			QByteArray annotation;
 
 			{
-				auto zipFiles = Zip::CreateZipFileController();
-				std::ranges::for_each(data, [&](auto& value) {
-					value.second.first.prepend(' ');
-					value.second.first.append(' ');
-					zipFiles->AddFile(value.first, ReplaceTags(value.second.first).simplified().toUtf8());
-				});
-
 				QBuffer          buffer(&annotation);
 				const ScopedCall bufferGuard(
 					[&] {
@@ -246,17 +240,23 @@ std::vector<std::tuple<int, QByteArray, QByteArray>> CreateAuthorAnnotationsData
 						buffer.close();
 					}
 				);
-				Zip zip(buffer, Zip::Format::SevenZip);
-				zip.SetProperty(ZipDetails::PropertyId::SolidArchive, false);
-				zip.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
-				zip.Write(*zipFiles);
+				ArchiveWriter writer(buffer, Zip::Format::SevenZip);
+				writer.SetProperty(ZipDetails::PropertyId::SolidArchive, false);
+				writer.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
+				std::ranges::for_each(data, [&](auto& value) {
+					value.second.first.prepend(' ');
+					value.second.first.append(' ');
+					writer.Append(value.first, ReplaceTags(value.second.first).simplified().toUtf8());
+				});
+				writer.Finalize();
 			}
 
 			QByteArray pictures;
 
 			if (pics)
 			{
-				auto zipFiles = Zip::CreateZipFileController();
+				QBuffer       buffer(&pictures);
+				ArchiveWriter writer(buffer, Zip::Format::Zip);
 				for (const auto& [dstFolder, values] : data)
 				{
 					std::unordered_set<QString> uniqueFiles;
@@ -276,14 +276,13 @@ std::vector<std::tuple<int, QByteArray, QByteArray>> CreateAuthorAnnotationsData
 							if (picBody.isEmpty())
 								PLOGW << fileSplit.join("/") << " is empty";
 							else
-								zipFiles->AddFile(QString("%1/%2").arg(dstFolder, fileSplit.back()), picBody, pics->GetFileTime(file));
+								writer.Append(QString("%1/%2").arg(dstFolder, fileSplit.back()), std::move(picBody), pics->GetFileTime(file));
 						}
 					}
 				}
 
-				pictureCount = zipFiles->GetCount();
+				pictureCount = writer.GetCount();
 
-				QBuffer          buffer(&pictures);
 				const ScopedCall bufferGuard(
 					[&] {
 						buffer.open(QIODevice::WriteOnly);
@@ -294,8 +293,7 @@ std::vector<std::tuple<int, QByteArray, QByteArray>> CreateAuthorAnnotationsData
 				);
 
 				std::lock_guard zipLock(zipGuard);
-				Zip             zip(buffer, Zip::Format::Zip);
-				zip.Write(*zipFiles);
+				writer.Finalize();
 			}
 
 			std::lock_guard lock(archivesGuard);
@@ -0,0 +1,177 @@
+#include "EncodeCache.h"
+
+#include <algorithm>
+#include <ranges>
+#include <vector>
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "log.h"
+#include "settings.h"
+
+using namespace HomeCompa::fb2cut;
+
+namespace
+{
+
+constexpr quint32 SIGNATURE = 0x46424543;
+constexpr quint32 VERSION   = 1;
+
+constexpr qint64 PRUNE_TARGET_PERCENTS = 90;
+
+}
+
+EncodeCache::EncodeCache(const QString& path, const qint64 maxSize)
+	: m_dir { path }
+	, m_maxSize { maxSize }
+{
+	if (!m_dir.exists() && !m_dir.mkpath("."))
+		throw std::ios_base::failure(QString("Cannot create folder %1").arg(path).toStdString());
+
+	Load();
+	PLOGI << QString("encode cache: %1, %2 entries, %3 MB").arg(m_dir.path()).arg(m_entries.size()).arg(m_size / 1024 / 1024);
+
+	std::lock_guard lock(m_guard);
+	Prune();
+}
+
+EncodeCache::~EncodeCache()
+{
+	const auto total = m_hitCount + m_missCount;
+	PLOGI << QString("encode cache: %1 hits of %2 lookups (%3%), %4 entries evicted")
+				 .arg(m_hitCount.load())
+				 .arg(total)
+				 .arg(total ? 100.0 * static_cast<double>(m_hitCount) / static_cast<double>(total) : 0.0, 0, 'f', 1)
+				 .arg(m_evictedCount.load());
+}
+
+QString EncodeCache::GetKey(const QString& bodyHash, const ImageSettings& settings, const int quality, const QString& hashAlgorithm, const bool jpegTranscode)
+{
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	hash.addData(QString("%1x%2|%3|%4|%5").arg(settings.maxSize.width()).arg(settings.maxSize.height()).arg(quality).arg(settings.grayscale ? 1 : 0).arg(hashAlgorithm).toUtf8());
+	if (jpegTranscode)
+		hash.addData("|jpeg");
+
+	return QString("%1%2").arg(bodyHash, QString::fromUtf8(hash.result().toHex().left(8)));
+}
+
+std::optional<EncodeCache::Item> EncodeCache::Get(const QString& key)
+{
+	QFile file(GetFilePath(key));
+	if (!file.open(QIODevice::ReadOnly))
+		return ++m_missCount, std::nullopt;
+
+	Item    item { .key = key };
+	quint32 signature = 0, version = 0;
+
+	QDataStream stream(&file);
+	stream >> signature >> version;
+	if (signature == SIGNATURE && version == VERSION)
+		stream >> item.hash >> item.width >> item.height >> item.pixelSchema >> item.body;
+
+	if (signature != SIGNATURE || version != VERSION || stream.status() != QDataStream::Ok || item.body.isEmpty())
+	{
+		PLOGW << "encode cache: invalid entry " << file.fileName();
+		return ++m_missCount, std::nullopt;
+	}
+
+	file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+	Touch(key, file.size());
+
+	++m_hitCount;
+	return item;
+}
+
+void EncodeCache::Put(const Item& item)
+{
+	const auto filePath = GetFilePath(item.key);
+	if (const auto dir = QFileInfo(filePath).dir(); !dir.exists())
+		dir.mkpath(".");
+
+	QSaveFile file(filePath);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		PLOGW << "encode cache: cannot write " << filePath;
+		return;
+	}
+
+	QDataStream stream(&file);
+	stream << SIGNATURE << VERSION << item.hash << item.width << item.height << item.pixelSchema << item.body;
+
+	if (stream.status() != QDataStream::Ok || !file.commit())
+	{
+		PLOGW << "encode cache: cannot write " << filePath;
+		return;
+	}
+
+	Touch(item.key, QFileInfo(filePath).size());
+	if (m_maxSize <= 0)
+		return;
+
+	std::lock_guard lock(m_guard);
+	if (m_size > m_maxSize)
+		Prune();
+}
+
+QString EncodeCache::GetFilePath(const QString& key) const
+{
+	return m_dir.filePath(QString("%1/%2").arg(key.left(2), key));
+}
+
+void EncodeCache::Load()
+{
+	for (QDirIterator it(m_dir.path(), QDir::Files, QDirIterator::Subdirectories); it.hasNext();)
+	{
+		const auto fileInfo = it.nextFileInfo();
+		if (fileInfo.fileName().contains('.'))
+			continue;
+
+		m_entries.try_emplace(fileInfo.fileName(), Entry { fileInfo.size(), fileInfo.lastModified().toMSecsSinceEpoch() });
+		m_size += fileInfo.size();
+	}
+}
+
+void EncodeCache::Touch(const QString& key, const qint64 size)
+{
+	std::lock_guard lock(m_guard);
+	auto&           entry = m_entries[key];
+
+	m_size     += size - entry.size;
+	entry.size  = size;
+	entry.time  = QDateTime::currentMSecsSinceEpoch();
+}
+
+void EncodeCache::Prune()
+{
+	if (m_maxSize <= 0 || m_size <= m_maxSize)
+		return;
+
+	std::vector<std::pair<qint64, QString>> entries;
+	entries.reserve(m_entries.size());
+	std::ranges::transform(m_entries, std::back_inserter(entries), [](const auto& item) {
+		return std::make_pair(item.second.time, item.first);
+	});
+	std::ranges::sort(entries);
+
+	const auto targetSize = m_maxSize * PRUNE_TARGET_PERCENTS / 100;
+	for (const auto& key : entries | std::views::values)
+	{
+		if (m_size <= targetSize)
+			break;
+
+		const auto it = m_entries.find(key);
+		if (!QFile::remove(GetFilePath(key)))
+			PLOGW << "encode cache: cannot remove " << GetFilePath(key);
+
+		m_size -= it->second.size;
+		m_entries.erase(it);
+		++m_evictedCount;
+	}
+
+	PLOGI << QString("encode cache: pruned to %1 MB").arg(m_size / 1024 / 1024);
+}
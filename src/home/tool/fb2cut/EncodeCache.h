@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include <QDir>
+#include <QString>
+
+#include "fnd/NonCopyMovable.h"
+
+namespace HomeCompa::fb2cut
+{
+
+struct ImageSettings;
+
+class EncodeCache
+{
+	NON_COPY_MOVABLE(EncodeCache)
+
+public:
+	struct Item
+	{
+		QString    key;
+		QString    hash;
+		int        width { 0 };
+		int        height { 0 };
+		int        pixelSchema { -1 };
+		QByteArray body;
+	};
+
+public:
+	EncodeCache(const QString& path, qint64 maxSize);
+	~EncodeCache();
+
+public:
+	static QString GetKey(const QString& bodyHash, const ImageSettings& settings, int quality, const QString& hashAlgorithm, bool jpegTranscode);
+
+	std::optional<Item> Get(const QString& key);
+	void                Put(const Item& item);
+
+private:
+	QString GetFilePath(const QString& key) const;
+	void    Load();
+	void    Touch(const QString& key, qint64 size);
+	void    Prune();
+
+private:
+	struct Entry
+	{
+		qint64 size { 0 };
+		qint64 time { 0 };
+	};
+
+	const QDir   m_dir;
+	const qint64 m_maxSize;
+
+	std::mutex                         m_guard;
+	std::unordered_map<QString, Entry> m_entries;
+	qint64                             m_size { 0 };
+
+	std::atomic_int64_t m_hitCount { 0 };
+	std::atomic_int64_t m_missCount { 0 };
+	std::atomic_int64_t m_evictedCount { 0 };
+};
+
+} // namespace HomeCompa::fb2cut
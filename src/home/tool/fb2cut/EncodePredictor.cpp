@@ -0,0 +1,164 @@
+#include "EncodePredictor.h"
+
+#include <algorithm>
+#include <bit>
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QSaveFile>
+
+#include "lib/JpegTranscoder.h"
+
+#include "log.h"
+
+using namespace HomeCompa::fb2cut;
+
+namespace
+{
+
+constexpr quint32 SIGNATURE = 0x46424550;
+constexpr quint32 VERSION   = 2;
+
+constexpr quint64 MIN_HISTORY_COUNT    = 32;
+constexpr quint64 MIN_SHRUNK_PERCENTS  = 5;
+constexpr quint32 MAX_BITS_PER_PIXEL_4 = 63;
+
+enum class Format : quint32
+{
+	Unknown,
+	Jpeg,
+	Png,
+	Gif,
+};
+
+Format GetFormat(const QByteArray& body)
+{
+	if (HomeCompa::FliLib::IsJpeg(body))
+		return Format::Jpeg;
+	if (body.startsWith("\x89PNG"))
+		return Format::Png;
+	if (body.startsWith("GIF8"))
+		return Format::Gif;
+	return Format::Unknown;
+}
+
+quint32 GetKey(const QByteArray& body, const QImage& image, const int quality)
+{
+	const auto qualityClass = static_cast<quint32>(std::clamp(quality, -1, 100) + 1);
+	const auto pixelCount   = std::max<quint64>(static_cast<quint64>(image.width()) * static_cast<quint64>(image.height()), 1);
+	const auto bitsPerPixel = std::min(static_cast<quint32>(static_cast<quint64>(body.size()) * 8 * 4 / pixelCount), MAX_BITS_PER_PIXEL_4);
+	const auto sizeClass    = static_cast<quint32>(std::bit_width(pixelCount));
+
+	return qualityClass << 24 | static_cast<quint32>(GetFormat(body)) << 16 | bitsPerPixel << 8 | sizeClass;
+}
+
+}
+
+EncodePredictor::EncodePredictor(QString filePath, const int calibrationRate)
+	: m_filePath { std::move(filePath) }
+	, m_calibrationRate { std::max(calibrationRate, 1) }
+{
+	Load();
+	PLOGI << QString("encode predictor: %1 image classes loaded from %2").arg(m_history.size()).arg(m_filePath);
+}
+
+EncodePredictor::~EncodePredictor()
+{
+	Save();
+	PLOGI << QString("encode predictor: %1 encodings skipped, %2 predicted skips sampled, %3 of them shrank (false skips)")
+				 .arg(m_skipCount.load())
+				 .arg(m_sampleCount.load())
+				 .arg(m_falseSkipCount.load());
+}
+
+EncodePredictor::Prediction EncodePredictor::Predict(const QByteArray& body, const QImage& image, const int quality)
+{
+	Prediction prediction { .key = GetKey(body, image, quality) };
+
+	{
+		std::lock_guard lock(m_guard);
+		const auto      it = m_history.find(prediction.key);
+		if (it == m_history.end() || it->second.count < MIN_HISTORY_COUNT || it->second.shrunk * 100 >= it->second.count * MIN_SHRUNK_PERCENTS)
+			return prediction;
+	}
+
+	if (++m_predictedSkipCount % m_calibrationRate == 0)
+	{
+		++m_sampleCount;
+		prediction.sample = true;
+		return prediction;
+	}
+
+	++m_skipCount;
+	prediction.encode = false;
+	return prediction;
+}
+
+void EncodePredictor::Update(const Prediction& prediction, const bool shrunk)
+{
+	if (prediction.sample && shrunk)
+		++m_falseSkipCount;
+
+	std::lock_guard lock(m_guard);
+	auto&           item = m_history[prediction.key];
+	++item.count;
+	if (shrunk)
+		++item.shrunk;
+}
+
+void EncodePredictor::Load()
+{
+	QFile file(m_filePath);
+	if (!file.open(QIODevice::ReadOnly))
+		return;
+
+	quint32 signature = 0, version = 0, count = 0;
+
+	QDataStream stream(&file);
+	stream >> signature >> version >> count;
+	if (signature != SIGNATURE || version != VERSION)
+	{
+		PLOGW << "encode predictor: invalid history " << m_filePath;
+		return;
+	}
+
+	for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i)
+	{
+		quint32     key = 0;
+		HistoryItem item;
+		stream >> key >> item.count >> item.shrunk;
+		m_history.try_emplace(key, item);
+	}
+
+	if (stream.status() != QDataStream::Ok)
+	{
+		PLOGW << "encode predictor: invalid history " << m_filePath;
+		m_history.clear();
+	}
+}
+
+void EncodePredictor::Save() const
+{
+	if (const auto dir = QFileInfo(m_filePath).dir(); !dir.exists())
+		dir.mkpath(".");
+
+	QSaveFile file(m_filePath);
+	if (!file.open(QIODevice::WriteOnly))
+	{
+		PLOGW << "encode predictor: cannot write " << m_filePath;
+		return;
+	}
+
+	std::lock_guard lock(m_guard);
+
+	QDataStream stream(&file);
+	stream << SIGNATURE << VERSION << static_cast<quint32>(m_history.size());
+	for (const auto& [key, item] : m_history)
+		stream << key << item.count << item.shrunk;
+
+	if (stream.status() != QDataStream::Ok || !file.commit())
+		PLOGW << "encode predictor: cannot write " << m_filePath;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+#include <QByteArray>
+#include <QString>
+
+#include "fnd/NonCopyMovable.h"
+
+class QImage;
+
+namespace HomeCompa::fb2cut
+{
+
+class EncodePredictor
+{
+	NON_COPY_MOVABLE(EncodePredictor)
+
+public:
+	struct Prediction
+	{
+		quint32 key { 0 };
+		bool    encode { true };
+		bool    sample { false };
+	};
+
+public:
+	EncodePredictor(QString filePath, int calibrationRate);
+	~EncodePredictor();
+
+public:
+	Prediction Predict(const QByteArray& body, const QImage& image, int quality);
+	void       Update(const Prediction& prediction, bool shrunk);
+
+private:
+	void Load();
+	void Save() const;
+
+private:
+	struct HistoryItem
+	{
+		quint64 count { 0 };
+		quint64 shrunk { 0 };
+	};
+
+	const QString m_filePath;
+	const int     m_calibrationRate;
+
+	mutable std::mutex                       m_guard;
+	std::unordered_map<quint32, HistoryItem> m_history;
+
+	std::atomic_int64_t m_predictedSkipCount { 0 };
+	std::atomic_int64_t m_skipCount { 0 };
+	std::atomic_int64_t m_sampleCount { 0 };
+	std::atomic_int64_t m_falseSkipCount { 0 };
+};
+
+} // namespace HomeCompa::fb2cut
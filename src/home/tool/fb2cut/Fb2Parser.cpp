@@ -1,12 +1,17 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
 #include <set>
 #include <stack>
+#include <string>
+#include <string_view>
 #include <unordered_set>
 
 #include <QBuffer>
 #include <QCryptographicHash>
 #include <QFileInfo>
 #include <QIODevice>
-#include <QRegularExpression>
 #include <QString>
 
 #include "fnd/FindPair.h"
@@ -19,6 +24,7 @@
 #include "util/xml/XmlWriter.h"
 
 #include "IParser.h"
+#include "StageStatistics.h"
 #include "log.h"
 
 #include "config/version.h"
@@ -44,6 +50,8 @@ constexpr auto PROGRAM_USED    = "FictionBook/description/document-info/program-
 constexpr auto CUSTOM_INFO = "custom-info";
 constexpr auto BR          = "br";
 
+constexpr std::string_view SPECIALS[] { "amp;", "apos;", "gt;", "lt;", "quot;" };
+
 constexpr const char* FB2_TAGS[] {
 	"p",
 	"fictionbook",
@@ -129,170 +137,913 @@ constexpr const char* FB2_TAGS[] {
 	"col",
 };
 
-const std::unordered_set<QString> FB2_TAGS_CACHE { std::begin(FB2_TAGS), std::end(FB2_TAGS) };
+const std::unordered_set<QString> FB2_TAGS_CACHE { std::begin(FB2_TAGS), std::end(FB2_TAGS) };
+
+constexpr size_t FB2_TAGS_TABLE_SIZE = 512;
+
+constexpr size_t FB2_TAG_MAX_LENGTH = [] {
+	size_t result = 0;
+	for (const std::string_view tag : FB2_TAGS)
+		result = std::max(result, tag.size());
+	return result;
+}();
+
+constexpr uint32_t GetTagHash(const std::string_view name) noexcept
+{
+	uint32_t hash = 2166136261U;
+	for (const auto ch : name)
+		hash = (hash ^ static_cast<uint8_t>(ch)) * 16777619U;
+	return hash;
+}
+
+constexpr size_t GetTagSlot(const uint32_t hash, const uint32_t seed) noexcept
+{
+	return ((hash ^ seed) * 0x9E3779B1U) >> 23;
+}
+
+static_assert(size_t { 1 } << (32 - 23) == FB2_TAGS_TABLE_SIZE);
+
+constexpr uint32_t FB2_TAGS_SEED = [] {
+	for (uint32_t seed = 1;; ++seed)
+	{
+		std::array<bool, FB2_TAGS_TABLE_SIZE> used {};
+		if (std::ranges::none_of(FB2_TAGS, [&](const std::string_view tag) {
+				return std::exchange(used[GetTagSlot(GetTagHash(tag), seed)], true);
+			}))
+			return seed;
+	}
+}();
+
+constexpr auto FB2_TAGS_TABLE = [] {
+	std::array<int8_t, FB2_TAGS_TABLE_SIZE> table {};
+	table.fill(-1);
+	for (size_t i = 0; i < std::size(FB2_TAGS); ++i)
+		table[GetTagSlot(GetTagHash(FB2_TAGS[i]), FB2_TAGS_SEED)] = static_cast<int8_t>(i);
+	return table;
+}();
+
+constexpr int FindFb2Tag(const std::string_view name) noexcept
+{
+	const auto index = FB2_TAGS_TABLE[GetTagSlot(GetTagHash(name), FB2_TAGS_SEED)];
+	return index >= 0 && name == FB2_TAGS[index] ? index : -1;
+}
+
+constexpr auto BR_TAG_INDEX          = FindFb2Tag(BR);
+constexpr auto CUSTOM_INFO_TAG_INDEX = FindFb2Tag(CUSTOM_INFO);
+static_assert(BR_TAG_INDEX >= 0 && CUSTOM_INFO_TAG_INDEX >= 0);
+
+constexpr qsizetype GetUtf8Length(const uint8_t lead) noexcept
+{
+	return lead < 0x80 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+}
+
+qsizetype GetValidUtf8Length(const char* it, const char* end) noexcept
+{
+	const auto lead  = static_cast<uint8_t>(*it);
+	const auto count = lead < 0xC2 || lead > 0xF4 ? 0 : GetUtf8Length(lead) - 1;
+	if (count == 0 || end - it <= count)
+		return 0;
+
+	uint32_t code = lead & (0x3F >> count);
+	for (qsizetype i = 1; i <= count; ++i)
+	{
+		const auto next = static_cast<uint8_t>(it[i]);
+		if ((next & 0xC0) != 0x80)
+			return 0;
+		code = (code << 6) | (next & 0x3F);
+	}
+
+	static constexpr uint32_t minCode[] { 0, 0x80, 0x800, 0x10000 };
+	return code < minCode[count] || (code >= 0xD800 && code <= 0xDFFF) || code > 0x10FFFF ? 0 : count + 1;
+}
+
+struct FoldedChar
+{
+	char      ch { 0 };
+	qsizetype length { 1 };
+};
+
+FoldedChar GetFoldedChar(const char* it, const char* end) noexcept
+{
+	const auto byte = static_cast<uint8_t>(*it);
+	if (byte < 0x80)
+		return { static_cast<char>(byte >= 'A' && byte <= 'Z' ? byte | 0x20 : byte), 1 };
+	if (end - it >= 2 && byte == 0xC5 && static_cast<uint8_t>(it[1]) == 0xBF)
+		return { 's', 2 };
+	if (end - it >= 3 && byte == 0xE2 && static_cast<uint8_t>(it[1]) == 0x84 && static_cast<uint8_t>(it[2]) == 0xAA)
+		return { 'k', 3 };
+	return { 0, std::min(GetUtf8Length(byte), static_cast<qsizetype>(end - it)) };
+}
+
+constexpr bool IsAsciiDigit(const char ch) noexcept
+{
+	return ch >= '0' && ch <= '9';
+}
+
+constexpr bool IsAsciiLetter(const char ch) noexcept
+{
+	return ch >= 'a' && ch <= 'z';
+}
+
+constexpr bool IsAsciiAlnum(const char ch) noexcept
+{
+	return IsAsciiDigit(ch) || IsAsciiLetter(ch);
+}
+
+bool IsEmail(const std::string_view value)
+{
+	const auto at = value.find('@');
+	if (at == std::string_view::npos || value.find('@', at + 1) != std::string_view::npos)
+		return false;
+
+	const auto local = value.substr(0, at), domain = value.substr(at + 1);
+	if (local.size() < 2 || !IsAsciiAlnum(local.front()) || !IsAsciiAlnum(local.back()) || !std::ranges::all_of(local, [](const char ch) {
+			return IsAsciiAlnum(ch) || IsOneOf(ch, '-', '.', '_', '+');
+		}))
+		return false;
+
+	const auto dot = domain.rfind('.');
+	if (dot == std::string_view::npos)
+		return false;
+
+	const auto host = domain.substr(0, dot), zone = domain.substr(dot + 1);
+	if (zone.size() < 2 || zone.size() > 6 || !std::ranges::all_of(zone, IsAsciiLetter))
+		return false;
+
+	if (host.empty() || !IsAsciiAlnum(host.front()) || !IsAsciiAlnum(host.back()))
+		return false;
+
+	for (size_t i = 0; i < host.size(); ++i)
+		if (!IsAsciiAlnum(host[i]) && (!IsOneOf(host[i], '-', '.') || !IsAsciiAlnum(host[i + 1])))
+			return false;
+
+	return true;
+}
+
+const char* MatchEmail(const char* it, const char* end)
+{
+	std::string folded;
+	while (it < end)
+	{
+		const auto [ch, length] = GetFoldedChar(it, end);
+		if (!IsAsciiAlnum(ch) && !IsOneOf(ch, '-', '.', '_', '+', '@'))
+			break;
+
+		folded.push_back(ch);
+		it += length;
+	}
+
+	return it < end && *it == '>' && IsEmail(folded) ? it : nullptr;
+}
+
+const char* MatchFolded(const char* it, const char* end, const std::string_view pattern) noexcept
+{
+	for (const auto expected : pattern)
+	{
+		if (it == end)
+			return nullptr;
+
+		const auto [ch, length] = GetFoldedChar(it, end);
+		if (ch != expected)
+			return nullptr;
+
+		it += length;
+	}
+
+	return it;
+}
+
+QByteArray NormalizeInput(const QByteArray& input)
+{
+	const auto* const begin = input.constData();
+	const auto* const end   = begin + input.size();
+
+	QByteArray  result;
+	const char* copied  = begin;
+	bool        changed = false;
+	const auto  flush   = [&](const char* to) {
+		if (!std::exchange(changed, true))
+			result.reserve(input.size());
+		result.append(copied, to - copied);
+	};
+
+	const auto* it = begin;
+	if (input.startsWith("\xEF\xBB\xBF"))
+	{
+		flush(begin);
+		copied = it = begin + 3;
+	}
+
+	while (it < end)
+	{
+		const auto byte = static_cast<uint8_t>(*it);
+		if (byte >= 0x80)
+		{
+			if (const auto length = GetValidUtf8Length(it, end))
+			{
+				it += length;
+				continue;
+			}
+
+			flush(it);
+			result.append("\xEF\xBF\xBD");
+			copied = ++it;
+			continue;
+		}
+
+		if (byte != '<')
+		{
+			++it;
+			continue;
+		}
+
+		if (const auto* emailEnd = MatchEmail(it + 1, end))
+		{
+			flush(it);
+			result.append('"').append(it + 1, emailEnd - it - 1).append('"');
+			copied = it = emailEnd + 1;
+			continue;
+		}
+
+		if (const auto* sectionEnd = MatchFolded(it, end, "<section id=n"); sectionEnd && end - sectionEnd >= 2 && IsAsciiDigit(sectionEnd[0]) && sectionEnd[1] == '>')
+		{
+			flush(it);
+			result.append(R"(<section id="n)").append(sectionEnd[0]).append(R"(">)");
+			copied = it = sectionEnd + 2;
+			continue;
+		}
+
+		++it;
+	}
+
+	if (!changed)
+		return input;
+
+	flush(end);
+	return result;
+}
+
+int FindFb2TagAfter(const char* it, const char* end) noexcept
+{
+	std::array<char, FB2_TAG_MAX_LENGTH> name {};
+	size_t                               length = 0;
+	while (it < end)
+	{
+		if (IsOneOf(*it, ' ', '>', '/', '\x0d', '\x0a'))
+			return FindFb2Tag(std::string_view(name.data(), length));
+
+		const auto [ch, size] = GetFoldedChar(it, end);
+		if (ch == 0 || length == name.size())
+			return -1;
+
+		name[length++] = ch;
+		it += size;
+	}
+
+	return -1;
+}
+
+int FindFb2TagBefore(const char* begin, const char* it) noexcept
+{
+	std::array<char, FB2_TAG_MAX_LENGTH> name {};
+	size_t                               length = 0;
+	while (it > begin)
+	{
+		const auto* prev = it - 1;
+		while (prev > begin && (static_cast<uint8_t>(*prev) & 0xC0) == 0x80)
+			--prev;
+
+		if (IsOneOf(*prev, '<', '/'))
+		{
+			std::reverse(name.begin(), name.begin() + static_cast<ptrdiff_t>(length));
+			return FindFb2Tag(std::string_view(name.data(), length));
+		}
+
+		const auto [ch, size] = GetFoldedChar(prev, it);
+		if (ch == 0 || length == name.size())
+			return -1;
+
+		name[length++] = ch;
+		it             = prev;
+	}
+
+	return -1;
+}
+
+void RemoveOrphanCloseTags(QByteArray& body)
+{
+	auto* const       data = body.data();
+	const auto* const end  = data + body.size();
+
+	auto*       dst  = data;
+	const auto* src  = data;
+	const auto  copy = [&](const char* to) {
+		if (dst != src)
+			std::memmove(dst, src, static_cast<size_t>(to - src));
+		dst += to - src;
+		src = to;
+	};
+
+	while (src < end)
+	{
+		const auto* tagBegin = static_cast<const char*>(std::memchr(src, '<', static_cast<size_t>(end - src)));
+		if (!tagBegin || end - tagBegin < 2)
+			break;
+
+		if (tagBegin[1] != '/')
+		{
+			copy(tagBegin + 1);
+			continue;
+		}
+
+		copy(tagBegin);
+
+		const auto* it = tagBegin + 2;
+		for (qsizetype count = 0; it < end; ++count)
+		{
+			if (*it == '>' && count > 0)
+				break;
+
+			const auto [ch, length] = GetFoldedChar(it, end);
+			if (IsAsciiLetter(ch))
+				break;
+
+			it += length;
+		}
+
+		if (it < end && *it == '>')
+			src = it + 1;
+		else
+			copy(it);
+	}
+
+	copy(end);
+	body.resize(dst - data);
+}
+
+QByteArray FixInputFile(const QByteArray& inputFileBody)
+{
+	const auto        input = NormalizeInput(inputFileBody);
+	const auto* const begin = input.constData();
+	const auto* const end   = begin + input.size();
+
+	const auto* it = begin;
+	if (const auto index = input.indexOf("?>"); index >= 0)
+	{
+		it += index + 2;
+		if (it < end)
+			it += GetUtf8Length(static_cast<uint8_t>(*it));
+	}
+	else
+	{
+		for (int units = 0; units < 2 && it < end; it += GetUtf8Length(static_cast<uint8_t>(*it)))
+			units += GetUtf8Length(static_cast<uint8_t>(*it)) == 4 ? 2 : 1;
+	}
+
+	QByteArray output;
+	output.reserve(input.size() + input.size() / 16);
+	output.append(begin, it - begin);
+
+	bool lineBreak    = false;
+	bool isCustomInfo = false;
+	while (it < end)
+	{
+		const auto ch = *it;
+		if (IsOneOf(ch, '\x0d', '\x0a'))
+		{
+			if (!std::exchange(lineBreak, true))
+				output.append("\x0d\x0a");
+			++it;
+			continue;
+		}
+
+		lineBreak = false;
+
+		if (static_cast<uint8_t>(ch) >= 0x80)
+		{
+			const auto length = std::min(GetUtf8Length(static_cast<uint8_t>(ch)), static_cast<qsizetype>(end - it));
+			output.append(it, length);
+			it += length;
+			continue;
+		}
+
+		if (ch == '&' && std::ranges::none_of(SPECIALS, [&](const std::string_view special) {
+				return std::string_view(it + 1, static_cast<size_t>(end - it - 1)).starts_with(special);
+			}))
+		{
+			output.append("&amp;");
+			++it;
+			continue;
+		}
+
+		if (ch == '<' && !(end - it > 1 && it[1] == '/'))
+		{
+			const auto tag = FindFb2TagAfter(it + 1, end);
+			if (!isCustomInfo && tag < 0)
+			{
+				output.append("&lt;");
+				++it;
+				continue;
+			}
+
+			if (tag == BR_TAG_INDEX)
+			{
+				it += 3;
+				continue;
+			}
+
+			if (tag == CUSTOM_INFO_TAG_INDEX)
+				isCustomInfo = true;
+		}
+
+		if (ch == '>' && !IsOneOf(it[-1], '/', '"'))
+		{
+			const auto tag = FindFb2TagBefore(begin, it);
+			if (!isCustomInfo && tag < 0)
+			{
+				output.append("&gt;");
+				++it;
+				continue;
+			}
+
+			if (tag == BR_TAG_INDEX)
+			{
+				++it;
+				continue;
+			}
+
+			if (tag == CUSTOM_INFO_TAG_INDEX)
+				isCustomInfo = false;
+		}
+
+		if (static_cast<uint8_t>(ch) >= 0x20)
+			output.append(ch);
+		++it;
+	}
+
+	RemoveOrphanCloseTags(output);
+	output.replace("<p ", "<p> ");
+	output.replace(" /p>", "</p> ");
+
+	return output;
+}
+
+QByteArray ToValidUtf8(QByteArray body)
+{
+	if (body.startsWith("\xEF\xBB\xBF"))
+		body.remove(0, 3);
+
+	const auto* const begin = body.constData();
+	const auto* const end   = begin + body.size();
+
+	const auto* it = begin;
+	while (it < end)
+	{
+		if (static_cast<uint8_t>(*it) < 0x80)
+			++it;
+		else if (const auto length = GetValidUtf8Length(it, end))
+			it += length;
+		else
+			break;
+	}
+
+	if (it == end)
+		return body;
+
+	QByteArray result;
+	result.reserve(body.size() + 16);
+	result.append(begin, it - begin);
+	while (it < end)
+	{
+		if (static_cast<uint8_t>(*it) < 0x80)
+		{
+			result.append(*it++);
+		}
+		else if (const auto length = GetValidUtf8Length(it, end))
+		{
+			result.append(it, length);
+			it += length;
+		}
+		else
+		{
+			result.append("\xEF\xBF\xBD");
+			++it;
+		}
+	}
+
+	return result;
+}
+
+template <typename T>
+T TrimToFictionBookEnd(T body)
+{
+	const auto addEnd = [&](const qsizetype index) {
+		body.resize(index);
+		body.append("</FictionBook>");
+	};
+	if (const auto endIndex = body.indexOf("</FictionBook>"); endIndex > 0)
+	{
+		body.resize(endIndex + 14);
+	}
+	else if (const auto binaryIndex = body.lastIndexOf("<binary"); binaryIndex > 0)
+	{
+		addEnd(binaryIndex);
+	}
+	else if (const auto bodyIndex = body.lastIndexOf("</body>"); bodyIndex > 0)
+	{
+		addEnd(bodyIndex + 7);
+	}
+	return body;
+}
+
+QByteArray Decode(const Decoder& decoder, QByteArray inputFileBody)
+{
+	if (inputFileBody.size() < 100)
+		return {};
+
+	const auto encoding = [&inputFileBody]() -> QString {
+		static constexpr std::pair<const char*, const char*> UTF16[] {
+			{ "\xff\xfe", "UTF16LE" },
+			{ "\xfe\xff", "UTF16BE" },
+		};
+		const auto it = std::ranges::find_if(UTF16, [&](const auto& item) {
+			return inputFileBody.startsWith(item.first);
+		});
+
+		if (it != std::end(UTF16))
+			return it->second;
+
+		QBuffer buf(&inputFileBody);
+		buf.open(QIODevice::ReadOnly);
+		return Fb2EncodingParser::GetEncoding(buf).toUpper();
+	}();
+
+	if (encoding.isEmpty())
+		PLOGW << "encoding not found";
+
+	if (encoding.isEmpty() || IsOneOf(encoding, "UTF-8", "UTF8"))
+	{
+		auto body = ToValidUtf8(std::move(inputFileBody));
+		return body.isEmpty() ? QByteArray {} : TrimToFictionBookEnd(std::move(body));
+	}
+
+	auto str = decoder.Decode(encoding, inputFileBody.data());
+	if (const auto index = str.indexOf("?>") + 2; index >= 2)
+		str = R"(<?xml version="1.0" encoding="utf-8"?>)" + str.mid(index);
+
+	return str.isEmpty() ? QByteArray {} : TrimToFictionBookEnd(std::move(str)).toUtf8();
+}
+
+constexpr uint64_t SWAR_ONES = 0x0101010101010101ULL;
+constexpr uint64_t SWAR_HIGH = 0x8080808080808080ULL;
+
+constexpr uint64_t SwarHasLess(const uint64_t value, const uint8_t n) noexcept
+{
+	return (value - SWAR_ONES * n) & ~value & SWAR_HIGH;
+}
+
+constexpr uint64_t SwarHasByte(const uint64_t value, const uint8_t n) noexcept
+{
+	return SwarHasLess(value ^ (SWAR_ONES * n), 1);
+}
+
+class WellFormednessScanner
+{
+public:
+	static bool Scan(const QByteArray& body)
+	{
+		return WellFormednessScanner(body).Scan();
+	}
+
+private:
+	explicit WellFormednessScanner(const QByteArray& body)
+		: m_begin { body.constData() + (body.startsWith("\xEF\xBB\xBF") ? 3 : 0) }
+		, m_it { m_begin }
+		, m_end { body.constData() + body.size() }
+	{
+	}
+
+	bool Scan()
+	{
+		while (m_it < m_end)
+		{
+			SkipPlainText();
+			if (m_it == m_end)
+				break;
+
+			const auto ch = static_cast<uint8_t>(*m_it);
+			if (ch == '<')
+			{
+				if (!ScanMarkup())
+					return false;
+				continue;
+			}
+
+			if (m_tags.empty() && !IsOneOf(ch, ' ', '\t', '\r', '\n'))
+				return false;
+
+			if (!ScanChar())
+				return false;
+		}
+
+		return m_rootFound && m_tags.empty();
+	}
+
+	void SkipPlainText() noexcept
+	{
+		if (m_tags.empty())
+			return;
+
+		for (; m_end - m_it >= 8; m_it += 8)
+		{
+			uint64_t value = 0;
+			std::memcpy(&value, m_it, sizeof value);
+			if ((value & SWAR_HIGH) || SwarHasLess(value, 0x20) || SwarHasByte(value, '<') || SwarHasByte(value, '&') || SwarHasByte(value, '>'))
+				break;
+		}
+
+		for (; m_it < m_end; ++m_it)
+		{
+			const auto ch = static_cast<uint8_t>(*m_it);
+			if (ch < 0x20 || ch >= 0x80 || IsOneOf(ch, '<', '&', '>'))
+				return;
+		}
+	}
+
+	bool ScanChar() noexcept
+	{
+		const auto ch = static_cast<uint8_t>(*m_it);
+		if (ch == '&')
+			return ScanEntity();
+
+		if (ch == '>')
+			return !(m_it - m_begin >= 2 && m_it[-1] == ']' && m_it[-2] == ']') && (++m_it, true);
+
+		if (ch < 0x80)
+			return (ch >= 0x20 || IsOneOf(ch, '\t', '\r', '\n')) && (++m_it, true);
+
+		return ScanUtf8();
+	}
+
+	bool ScanUtf8() noexcept
+	{
+		const auto lead  = static_cast<uint8_t>(*m_it);
+		const int  count = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC2 ? 1 : 0;
+		if (count == 0 || lead > 0xF4 || m_end - m_it <= count)
+			return false;
+
+		uint32_t code = lead & (0x3F >> count);
+		for (int i = 1; i <= count; ++i)
+		{
+			const auto next = static_cast<uint8_t>(m_it[i]);
+			if ((next & 0xC0) != 0x80)
+				return false;
+			code = (code << 6) | (next & 0x3F);
+		}
+
+		static constexpr uint32_t minCode[] { 0, 0x80, 0x800, 0x10000 };
+		if (code < minCode[count] || !IsXmlChar(code))
+			return false;
+
+		m_it += count + 1;
+		return true;
+	}
+
+	static constexpr bool IsXmlChar(const uint32_t code) noexcept
+	{
+		return code == 0x09 || code == 0x0A || code == 0x0D || (code >= 0x20 && code <= 0xD7FF) || (code >= 0xE000 && code <= 0xFFFD) || (code >= 0x10000 && code <= 0x10FFFF);
+	}
+
+	bool ScanEntity() noexcept
+	{
+		static constexpr std::string_view entities[] { "amp;", "lt;", "gt;", "quot;", "apos;" };
+
+		++m_it;
+		const std::string_view tail(m_it, static_cast<size_t>(m_end - m_it));
+		if (const auto it = std::ranges::find_if(
+				entities,
+				[&](const auto entity) {
+					return tail.starts_with(entity);
+				}
+			);
+		    it != std::end(entities))
+			return m_it += it->size(), true;
+
+		if (tail.empty() || tail.front() != '#')
+			return false;
 
-QByteArray FixInputFile(const QByteArray& inputFileBody)
-{
-	auto str = QString::fromUtf8(inputFileBody);
+		const auto hex  = tail.size() > 1 && tail[1] == 'x';
+		uint32_t   code = 0;
+		size_t     i    = hex ? 2 : 1;
+		for (const auto start = i; i < tail.size() && i - start < 8; ++i)
+		{
+			const auto ch = tail[i];
+			if (ch >= '0' && ch <= '9')
+				code = code * (hex ? 16 : 10) + static_cast<uint32_t>(ch - '0');
+			else if (hex && ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'f'))
+				code = code * 16 + static_cast<uint32_t>((ch | 0x20) - 'a' + 10);
+			else
+				break;
+		}
+
+		if (i == (hex ? 2u : 1u) || i >= tail.size() || tail[i] != ';' || !IsXmlChar(code))
+			return false;
 
-	str.replace(
-		QRegularExpression(R"(<([0-9a-zA-Z]+([0-9a-zA-Z]*[-\._+])*[0-9a-zA-Z]+@[0-9a-zA-Z]+([-\.][0-9a-zA-Z]+)*([0-9a-zA-Z]*[\.])[a-zA-Z]{2,6})>)", QRegularExpression::CaseInsensitiveOption),
-		R"("\1")"
-	);
-	str.replace(QRegularExpression(R"(<section id=n(\d)>)", QRegularExpression::CaseInsensitiveOption), R"(<section id="n\1">)");
+		m_it += i + 1;
+		return true;
+	}
 
+	bool ScanMarkup()
 	{
-		const QString         customInfo = "custom-info";
-		const QString         br         = "br";
-		constexpr const char* specials[] { "amp;", "apos;", "gt;", "lt;", "quot;" };
-		const auto            index = str.indexOf(R"(?>)");
-		QString               buf   = str.first(index + 3);
-		buf.reserve(str.length());
-		bool lineBreak    = false;
-		bool isCustomInfo = false;
-		for (qsizetype i = buf.length(), sz = str.length(); i < sz; ++i)
-		{
-			const auto ch = str[i];
+		const std::string_view tail(m_it, static_cast<size_t>(m_end - m_it));
+		if (tail.starts_with("<?"))
+			return ScanProcessingInstruction();
+		if (tail.starts_with("<!--"))
+			return ScanTerminated(4, "-->") && !std::string_view(m_markupBegin, m_markupEnd).contains("--") && !std::string_view(m_markupBegin, m_markupEnd).ends_with('-');
+		if (tail.starts_with("<![CDATA["))
+			return !m_tags.empty() && ScanTerminated(9, "]]>");
+		if (tail.starts_with("</"))
+			return ScanEndTag();
+		if (tail.starts_with("<!"))
+			return false;
 
-			if (IsOneOf(ch, '\x0d', '\x0a'))
-			{
-				if (lineBreak)
-					continue;
+		return ScanStartTag();
+	}
 
-				buf.append("\x0d\x0a");
-				lineBreak = true;
-				continue;
-			}
+	bool ScanProcessingInstruction()
+	{
+		const auto isDeclaration = m_it == m_begin;
 
-			lineBreak = false;
+		m_it += 2;
+		const auto target = ScanName();
+		if (target.empty() || (!isDeclaration && target.size() == 3 && (target[0] | 0x20) == 'x' && (target[1] | 0x20) == 'm' && (target[2] | 0x20) == 'l'))
+			return false;
 
-			if (ch == QChar { '&' } && std::ranges::none_of(specials, [&](const char* special) {
-					return QStringView(str.constData() + i + 1, static_cast<qsizetype>(strlen(special))) == special;
-				}))
-			{
-				buf.append("&amp;");
-				continue;
-			}
+		return ScanTerminated(0, "?>");
+	}
 
-			if (ch == QChar { '<' } && str[i + 1] != '/')
-			{
-				const auto it = std::ranges::find_if(FB2_TAGS, [&](const QString& tag) {
-					const auto  tagLength = tag.length();
-					QStringView s(str.constData() + i + 1, tagLength);
-					const auto  nextCh = str[i + 1 + tagLength];
-					return s.compare(tag, Qt::CaseInsensitive) == 0 && IsOneOf(nextCh, ' ', '>', '/', '\x0d', '\x0a');
-				});
-				if (!isCustomInfo && it == std::end(FB2_TAGS))
-				{
-					buf.append("&lt;");
-					continue;
-				}
+	bool ScanTerminated(const size_t prefixLength, const std::string_view terminator)
+	{
+		m_markupBegin = m_it + prefixLength;
+		const auto pos = std::string_view(m_markupBegin, static_cast<size_t>(m_end - m_markupBegin)).find(terminator);
+		if (pos == std::string_view::npos)
+			return false;
 
-				if (br == *it)
-				{
-					i += 2;
-					continue;
-				}
+		m_markupEnd = m_markupBegin + pos;
+		for (m_it = m_markupBegin; m_it < m_markupEnd;)
+		{
+			const auto ch = static_cast<uint8_t>(*m_it);
+			if (ch >= 0x20 && ch < 0x80)
+				++m_it;
+			else if (ch >= 0x80 ? !ScanUtf8() : !(IsOneOf(ch, '\t', '\r', '\n') && (++m_it, true)))
+				return false;
+		}
 
-				if (customInfo == *it)
-					isCustomInfo = true;
-			}
+		m_it = m_markupEnd + terminator.size();
+		return true;
+	}
 
-			if (ch == QChar { '>' } && !IsOneOf(str[i - 1], '/', '"'))
-			{
-				const auto it = std::ranges::find_if(FB2_TAGS, [&](const QString& tag) {
-					const auto  tagLength = tag.length();
-					QStringView s(str.constData() + i - tagLength, tagLength);
-					const auto  prevCh = str[i - tagLength - 1];
-					return IsOneOf(prevCh, '<', '/') && s.compare(tag, Qt::CaseInsensitive) == 0;
-				});
-				if (!isCustomInfo && it == std::end(FB2_TAGS))
-				{
-					buf.append("&gt;");
-					continue;
-				}
+	std::string_view ScanName() noexcept
+	{
+		const auto begin   = m_it;
+		const auto isStart = [](const char ch) {
+			return ((ch | 0x20) >= 'a' && (ch | 0x20) <= 'z') || ch == '_' || ch == ':';
+		};
+		if (m_it == m_end || !isStart(*m_it))
+			return {};
 
-				if (br == *it)
-					continue;
+		for (++m_it; m_it < m_end && (isStart(*m_it) || (*m_it >= '0' && *m_it <= '9') || IsOneOf(*m_it, '-', '.')); ++m_it)
+			;
 
-				if (customInfo == *it)
-					isCustomInfo = false;
-			}
+		return { begin, static_cast<size_t>(m_it - begin) };
+	}
 
-			if (const auto value = ch.unicode(); value >= char16_t { 32 })
-				buf.append(ch);
-			else if (value == '\x0d')
-				buf.append("\x0d\x0a");
-		}
+	void SkipSpaces() noexcept
+	{
+		while (m_it < m_end && IsOneOf(*m_it, ' ', '\t', '\r', '\n'))
+			++m_it;
+	}
+
+	bool ScanEndTag()
+	{
+		m_it += 2;
+		const auto name = ScanName();
+		SkipSpaces();
+		if (m_it == m_end || *m_it != '>' || m_tags.empty() || m_tags.back() != name)
+			return false;
 
-		str = std::move(buf);
+		++m_it;
+		m_tags.pop_back();
+		return true;
 	}
 
-	str.replace(QRegularExpression(R"(</[^a-z]+?>)", QRegularExpression::CaseInsensitiveOption), "");
-	str.replace("<p ", "<p> ");
-	str.replace(" /p>", "</p> ");
+	bool ScanStartTag()
+	{
+		if (m_rootFound && m_tags.empty())
+			return false;
 
-	return str.toUtf8();
-}
+		++m_it;
+		const auto name = ScanName();
+		if (name.empty())
+			return false;
 
-QByteArray Decode(const Decoder& decoder, QByteArray inputFileBody)
-{
-	if (inputFileBody.size() < 100)
-		return {};
+		const auto isRoot = !m_rootFound;
+		m_rootFound       = true;
 
-	auto str = [&]() -> QString {
-		const auto encoding = [&inputFileBody]() -> QString {
-			static constexpr std::pair<const char*, const char*> UTF16[] {
-				{ "\xff\xfe", "UTF16LE" },
-				{ "\xfe\xff", "UTF16BE" },
-			};
-			const auto it = std::ranges::find_if(UTF16, [&](const auto& item) {
-				return inputFileBody.startsWith(item.first);
-			});
+		m_attributes.clear();
+		while (true)
+		{
+			const auto hasSpace = m_it < m_end && IsOneOf(*m_it, ' ', '\t', '\r', '\n');
+			SkipSpaces();
+			if (m_it == m_end)
+				return false;
 
-			if (it != std::end(UTF16))
-				return it->second;
+			if (*m_it == '>' || *m_it == '/')
+				break;
 
-			QBuffer buf(&inputFileBody);
-			buf.open(QIODevice::ReadOnly);
-			return Fb2EncodingParser::GetEncoding(buf).toUpper();
-		}();
+			const auto attribute = ScanName();
+			if (!hasSpace || attribute.empty() || std::ranges::find(m_attributes, attribute) != m_attributes.end())
+				return false;
 
-		if (encoding.isEmpty())
-		{
-			PLOGW << "encoding not found";
-			return inputFileBody;
-		}
+			m_attributes.push_back(attribute);
+			if (attribute.starts_with("xmlns:"))
+			{
+				if (!isRoot)
+					return false;
+				m_prefixes.emplace_back(attribute.substr(6));
+			}
 
-		if (IsOneOf(encoding, "UTF-8", "UTF8"))
-			return inputFileBody;
+			SkipSpaces();
+			if (m_it == m_end || *m_it++ != '=')
+				return false;
 
-		auto result = decoder.Decode(encoding, inputFileBody.data());
+			SkipSpaces();
+			if (m_it == m_end || !IsOneOf(*m_it, '"', '\''))
+				return false;
 
-		const auto index = result.indexOf("?>") + 2;
-		return index < 2 ? result : R"(<?xml version="1.0" encoding="utf-8"?>)" + result.mid(index);
-	}();
+			for (const auto quote = *m_it++; m_it < m_end && *m_it != quote;)
+				if (*m_it == '<' || !ScanChar())
+					return false;
 
-	if (str.isEmpty())
-		return {};
+			if (m_it == m_end)
+				return false;
 
-	const auto addEnd = [&](const qsizetype index) {
-		str.resize(index);
-		str.append("</FictionBook>");
-	};
-	if (const auto endIndex = str.indexOf("</FictionBook>"); endIndex > 0)
-	{
-		str.resize(endIndex + 14);
-	}
-	else if (const auto binaryIndex = str.lastIndexOf("<binary"); binaryIndex > 0)
-	{
-		addEnd(binaryIndex);
+			++m_it;
+		}
+
+		if (!CheckPrefix(name, false) || !std::ranges::all_of(m_attributes, [this](const auto attribute) {
+				return CheckPrefix(attribute, true);
+			}))
+			return false;
+
+		if (*m_it == '/')
+			return ++m_it != m_end && *m_it++ == '>';
+
+		++m_it;
+		m_tags.push_back(name);
+		return true;
 	}
-	else if (const auto bodyIndex = str.lastIndexOf("</body>"); bodyIndex > 0)
+
+	bool CheckPrefix(const std::string_view name, const bool isAttribute) const
 	{
-		addEnd(bodyIndex + 7);
+		const auto pos = name.find(':');
+		if (pos == std::string_view::npos)
+			return true;
+
+		const auto prefix = name.substr(0, pos), localName = name.substr(pos + 1);
+		if (prefix.empty() || localName.empty() || localName.find(':') != std::string_view::npos)
+			return false;
+
+		if (isAttribute && IsOneOf(prefix, std::string_view { "xmlns" }, std::string_view { "xml" }))
+			return true;
+
+		return std::ranges::find(m_prefixes, prefix) != m_prefixes.end();
 	}
-	return str.toUtf8();
+
+private:
+	const char* const             m_begin;
+	const char*                   m_it;
+	const char* const             m_end;
+	const char*                   m_markupBegin { nullptr };
+	const char*                   m_markupEnd { nullptr };
+	bool                          m_rootFound { false };
+	std::vector<std::string_view> m_tags;
+	std::vector<std::string_view> m_attributes;
+	std::vector<std::string_view> m_prefixes;
+};
+
+struct ValidationCounters
+{
+	std::atomic_size_t wellFormed { 0 };
+	std::atomic_size_t validated { 0 };
+	std::atomic_size_t fixed { 0 };
+	std::atomic_size_t failed { 0 };
+};
+
+ValidationCounters& GetValidationCounters()
+{
+	static ValidationCounters counters;
+	return counters;
 }
 
 QByteArray ValidateFileBody(const QString& inputFilePath, const QByteArray& inputFileBody, const Decoder& decoder, const Util::XmlValidator& validator)
@@ -300,16 +1051,43 @@ QByteArray ValidateFileBody(const QString& inputFilePath, const QByteArray& inpu
 	if (!inputFilePath.endsWith(".fb2", Qt::CaseInsensitive))
 		return inputFileBody;
 
-	auto fixedInputFileBody = Decode(decoder, inputFileBody);
-	if (auto errorText = Validate(validator, fixedInputFileBody); !errorText.isEmpty())
+	auto& counters           = GetValidationCounters();
+	auto  fixedInputFileBody = [&] {
+		StageTimer timer(Stage::Decode, inputFileBody.size());
+		auto       result = Decode(decoder, inputFileBody);
+		timer.SetBytesOut(result.size());
+		return result;
+	}();
+
+	QString errorText;
+	{
+		StageTimer timer(Stage::Validation, fixedInputFileBody.size());
+		if (WellFormednessScanner::Scan(fixedInputFileBody))
+			return ++counters.wellFormed, fixedInputFileBody;
+
+		if (errorText = Validate(validator, fixedInputFileBody); errorText.isEmpty())
+			return ++counters.validated, fixedInputFileBody;
+	}
+
+	PLOGW << errorText << " trying to fix";
 	{
-		PLOGW << errorText << " trying to fix";
+		StageTimer timer(Stage::FixInput, fixedInputFileBody.size());
 		fixedInputFileBody = FixInputFile(fixedInputFileBody);
-		if (errorText = Validate(validator, fixedInputFileBody); !errorText.isEmpty())
-			throw std::invalid_argument(errorText.toStdString());
+		timer.SetBytesOut(fixedInputFileBody.size());
+	}
+
+	{
+		StageTimer timer(Stage::Validation, fixedInputFileBody.size());
+		errorText = Validate(validator, fixedInputFileBody);
+	}
+
+	if (!errorText.isEmpty())
+	{
+		++counters.failed;
+		throw std::invalid_argument(errorText.toStdString());
 	}
 
-	return fixedInputFileBody;
+	return ++counters.fixed, fixedInputFileBody;
 }
 
 bool CheckImpl(QByteArray& inputFileBody)
@@ -352,159 +1130,190 @@ bool CheckImpl(QByteArray& inputFileBody)
 	return Checker(buffer).checked;
 }
 
-class Fb2ImageParser final : public Util::SaxParser
-{
-public:
-	struct ParseResult
-	{
-		bool        result   = false;
-		const char* encoding = "utf-8";
+const std::pair<QString, QString> REPLACE_CHAR[] {
+	{  "&lt;",  "<" },
+    {  "&gt;",  ">" },
+    {  "amp;",  "&" },
+    { "apos;",  "'" },
+    { "quot;", "\"" },
+};
 
-		operator bool() const noexcept
+QByteArray FromBase64(const QStringView value)
+{
+	static constexpr auto TABLE = [] {
+		std::array<int8_t, 128> table {};
+		table.fill(-1);
+		for (int8_t i = 0; i < 26; ++i)
 		{
-			return result;
+			table['A' + i] = i;
+			table['a' + i] = static_cast<int8_t>(26 + i);
 		}
-	};
-
-public:
-	static ParseResult Parse(QIODevice& input, IParser::OnBinaryFound binaryCallback, const IEncodingDetector& encodingDetector)
-	{
-		const Fb2ImageParser parser(input, std::move(binaryCallback));
-		return { .result = true, .encoding = encodingDetector.Detect(parser.GetText()) };
-	}
+		for (int8_t i = 0; i < 10; ++i)
+			table['0' + i] = static_cast<int8_t>(52 + i);
+		table['+'] = 62;
+		table['/'] = 63;
+		return table;
+	}();
 
-public:
-	Fb2ImageParser(QIODevice& input, IParser::OnBinaryFound binaryCallback)
-		: SaxParser(input, 512)
-		, m_binaryCallback { std::move(binaryCallback) }
-	{
-		SaxParser::Parse();
-	}
+	const auto get = [](const char16_t ch) -> int32_t {
+		return ch < TABLE.size() ? TABLE[ch] : -1;
+	};
 
-	const QString& GetText() const noexcept
-	{
-		return m_text;
-	}
+	QByteArray result(value.size() * 3 / 4 + 1, Qt::Uninitialized);
+	auto*      dst = result.data();
 
-private: // Util::SaxParser
-	bool OnStartElement(const QString&, const QString& path, const Util::XmlAttributes& attributes) override
+	uint32_t buf  = 0;
+	int      bits = 0;
+	for (const auto *src = value.utf16(), *end = src + value.size(); src != end;)
 	{
-		if (m_isBinary)
-			throw std::runtime_error("bad binary");
-
-		if (IsOneOf(path, BINARY, BODY_BINARY))
-		{
-			m_isBinary = true;
-			m_picId    = attributes.GetAttribute(ID).trimmed();
-			if (const auto it = std::ranges::find_if(
-					m_picId,
-					[](const auto ch) {
-						return ch != '#';
-					}
-				);
-			    it != m_picId.end())
-				m_picId = m_picId.last(std::distance(it, m_picId.end())).trimmed();
-			return true;
-		}
-
-		if (path == COVERPAGE_IMAGE)
+		if (bits == 0 && end - src >= 4)
 		{
-			for (size_t i = 0, sz = attributes.GetCount(); i < sz; ++i)
+			const auto a = get(src[0]), b = get(src[1]), c = get(src[2]), d = get(src[3]);
+			if ((a | b | c | d) >= 0)
 			{
-				auto attributeName  = attributes.GetName(i);
-				auto attributeValue = attributes.GetValue(i);
-				if (attributeName.endsWith(":href"))
-				{
-					if (const auto it = std::ranges::find_if(
-							attributeValue,
-							[](const auto ch) {
-								return ch != '#';
-							}
-						);
-					    it != attributeValue.end())
-						m_coverPage = attributeValue.last(std::distance(it, attributeValue.end())).trimmed();
-					break;
-				}
+				const auto quad  = static_cast<uint32_t>(a << 18 | b << 12 | c << 6 | d);
+				*dst++           = static_cast<char>(quad >> 16);
+				*dst++           = static_cast<char>(quad >> 8);
+				*dst++           = static_cast<char>(quad);
+				src             += 4;
+				continue;
 			}
-			return true;
 		}
 
-		return true;
-	}
-
-	bool OnEndElement(const QString&, const QString& path) override
-	{
-		if (IsOneOf(path, BINARY, BODY_BINARY))
-			m_isBinary = false;
-
-		return true;
-	}
-
-	bool OnCharacters([[maybe_unused]] const QString& path, const QString& value) override
-	{
-		m_text.append(' ').append(value);
-
-		if (m_picId.isEmpty())
-			return true;
-
-		if (!m_isBinary || !IsOneOf(path, BINARY, BODY_BINARY))
-			throw std::runtime_error("bad binary");
+		const auto d = get(*src++);
+		if (d < 0)
+			continue;
 
-		const auto isCover = m_picId == m_coverPage;
-		m_binaryCallback(std::move(m_picId), isCover, QByteArray::fromBase64(value.toUtf8()));
-		m_picId = {};
+		buf   = buf << 6 | static_cast<uint32_t>(d);
+		bits += 6;
+		if (bits < 8)
+			continue;
 
-		return true;
+		bits   -= 8;
+		*dst++  = static_cast<char>(buf >> bits);
+		buf    &= (1U << bits) - 1;
 	}
 
-private:
-	IParser::OnBinaryFound m_binaryCallback;
-
-	bool    m_isBinary { false };
-	QString m_coverPage;
-	QString m_picId;
-	QString m_text;
-};
+	result.resize(dst - result.data());
+	return result;
+}
 
-const std::pair<QString, QString> REPLACE_CHAR[] {
-	{  "&lt;",  "<" },
-    {  "&gt;",  ">" },
-    {  "amp;",  "&" },
-    { "apos;",  "'" },
-    { "quot;", "\"" },
-};
+QString TrimHash(const QString& value)
+{
+	const auto it = std::ranges::find_if(value, [](const auto ch) {
+		return ch != '#';
+	});
+	return it != value.end() ? value.last(std::distance(it, value.end())) : value;
+}
 
-class Fb2TextParser final : public Util::SaxParser
+class Fb2CutParser final : public Util::SaxParser
 {
+	struct TextItem
+	{
+		enum class Type
+		{
+			ProcessingInstruction,
+			StartElement,
+			Attribute,
+			Href,
+			Characters,
+			EndElement,
+		};
+
+		Type    type;
+		QString name;
+		QString value;
+	};
+
 public:
-	static void Parse(QString fileName, QIODevice& input, QIODevice& output, const std::unordered_map<QString, int>& replaceId, const char* encoding)
+	static void Parse(QString fileName, QIODevice& input, QIODevice& output, IParser::OnBinaryFound binaryCallback, const IParser::ImageMapper& idToNum, const IEncodingDetector& encodingDetector)
 	{
-		[[maybe_unused]] const Fb2TextParser parser(std::move(fileName), input, output, replaceId, encoding);
+		const Fb2CutParser parser(std::move(fileName), input, std::move(binaryCallback), encodingDetector);
+		parser.Write(output, idToNum, parser.m_encodingSession->GetEncoding());
 	}
 
-public:
-	Fb2TextParser(QString fileName, QIODevice& input, QIODevice& output, const std::unordered_map<QString, int>& replaceId, const char* encoding)
+private:
+	Fb2CutParser(QString fileName, QIODevice& input, IParser::OnBinaryFound binaryCallback, const IEncodingDetector& encodingDetector)
 		: SaxParser(input, 512)
 		, m_fileName { std::move(fileName) }
-		, m_replaceId { replaceId }
-		, m_writer(output, Util::XmlWriter::Options { .type = Util::XmlWriter::Type::Xml, .indented = false, .encoding = encoding })
+		, m_binaryCallback { std::move(binaryCallback) }
+		, m_encodingSession { encodingDetector.CreateSession() }
 	{
+		StageTimer timer(Stage::Parse, input.size());
 		SaxParser::Parse();
-		//		assert(m_tags.empty());
+	}
+
+	void Write(QIODevice& output, const IParser::ImageMapper& idToNum, const char* encoding) const
+	{
+		Util::XmlWriter writer(output, Util::XmlWriter::Options { .type = Util::XmlWriter::Type::Xml, .indented = false, .encoding = encoding });
+		for (const auto& [type, name, value] : m_textItems)
+		{
+			switch (type)
+			{
+				case TextItem::Type::ProcessingInstruction:
+					writer.WriteProcessingInstruction(name, value);
+					break;
+
+				case TextItem::Type::StartElement:
+					writer.WriteStartElement(name);
+					break;
+
+				case TextItem::Type::Attribute:
+					writer.WriteAttribute(name, value);
+					break;
+
+				case TextItem::Type::Href:
+					writer.WriteAttribute(name, ResolveHref(idToNum, value));
+					break;
+
+				case TextItem::Type::Characters:
+					writer.WriteCharacters(value);
+					break;
+
+				case TextItem::Type::EndElement:
+					writer.WriteEndElement();
+					break;
+			}
+		}
+
 		if (!m_tags.empty())
-			m_writer.WriteStartElement(QString::number(output.pos()));
+			writer.WriteStartElement(QString::number(output.pos()));
 	}
 
 private: // Util::SaxParser
 	bool OnProcessingInstruction(const QString& target, const QString& data) override
 	{
-		m_writer.WriteProcessingInstruction(target, data);
+		AddTextItem(TextItem::Type::ProcessingInstruction, target, data);
 		return true;
 	}
 
 	bool OnStartElement(const QString& name, const QString& path, const Util::XmlAttributes& attributes) override
 	{
-		if (name == BR)
+		if (m_isBinary)
+			throw std::runtime_error("bad binary");
+
+		const auto isBinary = IsOneOf(path, BINARY, BODY_BINARY);
+		if (isBinary)
+		{
+			m_isBinary = true;
+			m_picId    = TrimHash(attributes.GetAttribute(ID).trimmed()).trimmed();
+		}
+		else if (path == COVERPAGE_IMAGE)
+		{
+			for (size_t i = 0, sz = attributes.GetCount(); i < sz; ++i)
+			{
+				if (attributes.GetName(i).endsWith(":href"))
+				{
+					if (auto attributeValue = attributes.GetValue(i); std::ranges::any_of(attributeValue, [](const auto ch) {
+							return ch != '#';
+						}))
+						m_coverPage = TrimHash(attributeValue).trimmed();
+					break;
+				}
+			}
+		}
+
+		if (m_textStopped || name == BR)
 			return true;
 
 		if (name == CUSTOM_INFO)
@@ -513,7 +1322,7 @@ private: // Util::SaxParser
 		if (!m_isCustomInfo && !FB2_TAGS_CACHE.contains(name.toLower()))
 		{
 			PLOGW << "Unexpected tag: " << name;
-			m_writer.WriteCharacters(QString("<%1").arg(name));
+			AddTextItem(TextItem::Type::Characters, {}, QString("<%1").arg(name));
 			return true;
 		}
 
@@ -521,71 +1330,90 @@ private: // Util::SaxParser
 
 		if (path == FICTION_BOOK)
 		{
-			m_writer.WriteStartElement(name);
-			m_writer.WriteAttribute("xmlns", "http://www.gribuser.ru/xml/fictionbook/2.0");
-			m_writer.WriteAttribute("xmlns:l", "http://www.w3.org/1999/xlink");
+			AddTextItem(TextItem::Type::StartElement, name);
+			AddTextItem(TextItem::Type::Attribute, "xmlns", "http://www.gribuser.ru/xml/fictionbook/2.0");
+			AddTextItem(TextItem::Type::Attribute, "xmlns:l", "http://www.w3.org/1999/xlink");
 			return true;
 		}
 
-		if (IsOneOf(path, BINARY, BODY_BINARY))
+		if (isBinary)
 			return true;
 
-		m_writer.WriteStartElement(name);
+		AddTextItem(TextItem::Type::StartElement, name);
 		for (size_t i = 0, sz = attributes.GetCount(); i < sz; ++i)
-		{
-			auto attributeName  = attributes.GetName(i);
-			auto attributeValue = attributes.GetValue(i);
-			ReplaceAttribute(attributeName, attributeValue);
-			m_writer.WriteAttribute(attributeName, attributeValue);
-		}
+			AddAttribute(attributes.GetName(i), attributes.GetValue(i));
 
 		return true;
 	}
 
 	bool OnEndElement(const QString& name, const QString& path) override
 	{
-		if (name == BR)
+		const auto isBinary = IsOneOf(path, BINARY, BODY_BINARY);
+		if (isBinary)
+			m_isBinary = false;
+
+		if (m_textStopped || name == BR)
 			return true;
 
 		if (name == CUSTOM_INFO)
 			m_isCustomInfo = false;
 
 		if (!m_isCustomInfo && !FB2_TAGS_CACHE.contains(name.toLower()))
-			return m_writer.WriteCharacters(">"), true;
+			return AddTextItem(TextItem::Type::Characters, {}, ">"), true;
 
 		if (m_tags.top() != name)
-			return false;
+			return m_textStopped = true, true;
 
 		m_tags.pop();
 
 		if (path == DOCUMENT_INFO && !m_hasProgramUsed)
 		{
-			m_writer.WriteStartElement("program-used").WriteCharacters(QString("fb2cut %2").arg(PRODUCT_VERSION)).WriteEndElement();
+			AddTextItem(TextItem::Type::StartElement, "program-used");
+			AddTextItem(TextItem::Type::Characters, {}, QString("fb2cut %2").arg(PRODUCT_VERSION));
+			AddTextItem(TextItem::Type::EndElement);
 			m_hasProgramUsed = true;
 		}
 
 		if (path == DESCRIPTION && !m_hasProgramUsed)
 		{
-			m_writer.WriteStartElement("document-info").WriteStartElement("program-used").WriteCharacters(QString("fb2cut %2").arg(PRODUCT_VERSION)).WriteEndElement().WriteEndElement();
+			AddTextItem(TextItem::Type::StartElement, "document-info");
+			AddTextItem(TextItem::Type::StartElement, "program-used");
+			AddTextItem(TextItem::Type::Characters, {}, QString("fb2cut %2").arg(PRODUCT_VERSION));
+			AddTextItem(TextItem::Type::EndElement);
+			AddTextItem(TextItem::Type::EndElement);
 			m_hasProgramUsed = true;
 		}
 
-		if (IsOneOf(path, BINARY, BODY_BINARY))
+		if (isBinary)
 			return true;
 
-		m_writer.WriteEndElement();
+		AddTextItem(TextItem::Type::EndElement);
 
 		return true;
 	}
 
 	bool OnCharacters(const QString& path, const QString& value) override
 	{
-		if (IsOneOf(path, BINARY, BODY_BINARY))
+		const auto isBinary = IsOneOf(path, BINARY, BODY_BINARY);
+		if (!isBinary && m_encodingSampling)
+			m_encodingSampling = m_encodingSession->Add(value);
+
+		if (!m_picId.isEmpty())
+		{
+			if (!m_isBinary || !isBinary)
+				throw std::runtime_error("bad binary");
+
+			const auto isCover = m_picId == m_coverPage;
+			m_binaryCallback(std::move(m_picId), isCover, FromBase64(value));
+			m_picId = {};
+		}
+
+		if (m_textStopped || isBinary)
 			return true;
 
 		if (path == PROGRAM_USED)
 		{
-			m_writer.WriteCharacters(QString("%1, fb2cut %2").arg(value, PRODUCT_VERSION));
+			AddTextItem(TextItem::Type::Characters, {}, QString("%1, fb2cut %2").arg(value, PRODUCT_VERSION));
 			m_hasProgramUsed = true;
 			return true;
 		}
@@ -595,7 +1423,7 @@ private: // Util::SaxParser
 		for (const auto& [before, after] : REPLACE_CHAR)
 			valueCopy.replace(before, after, Qt::CaseInsensitive);
 
-		m_writer.WriteCharacters(valueCopy);
+		AddTextItem(TextItem::Type::Characters, {}, std::move(valueCopy));
 
 		return true;
 	}
@@ -609,51 +1437,61 @@ private: // Util::SaxParser
 	bool OnError(const size_t line, const size_t column, const QString& text) override
 	{
 		PLOGE << m_fileName << " " << line << ":" << column << " " << text;
-		return false;
+		m_textStopped = true;
+		return SaxParser::OnError(line, column, text);
 	}
 
 	bool OnFatalError(const size_t line, const size_t column, const QString& text) override
 	{
-		return OnError(line, column, text);
+		PLOGE << m_fileName << " " << line << ":" << column << " " << text;
+		m_textStopped = true;
+		return SaxParser::OnFatalError(line, column, text);
 	}
 
 private:
-	void ReplaceAttribute(QString& name, QString& value) const
+	void AddTextItem(const TextItem::Type type, QString name = {}, QString value = {})
+	{
+		m_textItems.emplace_back(type, std::move(name), std::move(value));
+	}
+
+	void AddAttribute(QString name, QString value)
 	{
 		if (name.startsWith("xlink:"))
 			name = "l:" + name.last(name.length() - 6);
 
 		if (!name.endsWith(":href"))
-			return;
-
-		name = L_HREF;
+			return AddTextItem(TextItem::Type::Attribute, std::move(name), std::move(value));
 
 		if (!value.startsWith('#'))
-			return;
+			return AddTextItem(TextItem::Type::Attribute, L_HREF, std::move(value));
 
-		if (const auto it = std::ranges::find_if(
-				value,
-				[](const auto ch) {
-					return ch != '#';
-				}
-			);
-		    it != value.end() && it != value.begin())
-			value = value.last(std::distance(it, value.end()));
+		AddTextItem(TextItem::Type::Href, L_HREF, TrimHash(value));
+	}
 
-		const auto it = m_replaceId.find(value);
-		if (it == m_replaceId.end())
-			return (void)value.prepend('#');
+	static QString ResolveHref(const IParser::ImageMapper& idToNum, const QString& value)
+	{
+		const auto it = idToNum.find(value);
+		if (it == idToNum.end())
+			return '#' + value;
 
-		value = it->second == -1 ? QString { "#cover" } : QString("#%1").arg(it->second);
+		return it->second == -1 ? QString { "#cover" } : QString("#%1").arg(it->second);
 	}
 
 private:
-	const QString                           m_fileName;
-	const std::unordered_map<QString, int>& m_replaceId;
-	Util::XmlWriter                         m_writer;
-	bool                                    m_hasProgramUsed { false };
-	std::stack<QString>                     m_tags;
-	bool                                    m_isCustomInfo { false };
+	const QString                                m_fileName;
+	IParser::OnBinaryFound                       m_binaryCallback;
+	std::unique_ptr<IEncodingDetector::ISession> m_encodingSession;
+	bool                                         m_encodingSampling { true };
+
+	bool    m_isBinary { false };
+	QString m_coverPage;
+	QString m_picId;
+
+	std::vector<TextItem> m_textItems;
+	std::stack<QString>   m_tags;
+	bool                  m_hasProgramUsed { false };
+	bool                  m_isCustomInfo { false };
+	bool                  m_textStopped { false };
 };
 
 class Fb2Parser final : public IParser
@@ -676,16 +1514,10 @@ private: // IParser
 		QBuffer input(&fixedInputFileBody);
 		input.open(QIODevice::ReadOnly);
 
-		const auto parseResult = Fb2ImageParser::Parse(input, std::move(binaryCallback), m_encodingDetector);
-		if (!parseResult)
-			return {};
-
-		input.seek(0);
-
 		QByteArray bodyOutput;
 		QBuffer    output(&bodyOutput);
 		output.open(QIODevice::WriteOnly);
-		Fb2TextParser::Parse(m_inputFilePath, input, output, idToNum, parseResult.encoding);
+		Fb2CutParser::Parse(m_inputFilePath, input, output, std::move(binaryCallback), idToNum, m_encodingDetector);
 
 //			const QFileInfo fileInfo(m_inputFilePath);
 #ifndef NDEBUG
@@ -735,4 +1567,10 @@ create_fb2_parser(QString inputFilePath, QByteArray inputFileBody, QByteArray /*
 	return std::make_unique<Fb2Parser>(std::move(inputFilePath), std::move(inputFileBody), encodingDetector, decoder, validator);
 }
 
+ValidationStatistics GetValidationStatistics()
+{
+	const auto& counters = GetValidationCounters();
+	return { counters.wellFormed, counters.validated, counters.fixed, counters.failed };
+}
+
 }
@@ -24,6 +24,16 @@ namespace HomeCompa::fb2cut
 
 class IEncodingDetector // NOLINT(cppcoreguidelines-special-member-functions)
 {
+public:
+	class ISession // NOLINT(cppcoreguidelines-special-member-functions)
+	{
+	public:
+		virtual ~ISession() = default;
+
+		virtual bool Add(QStringView text) = 0;
+		virtual const char* GetEncoding() const = 0;
+	};
+
 public:
 	using Ptr = std::unique_ptr<IEncodingDetector>;
 	static Ptr Create();
@@ -31,7 +41,7 @@ public:
 public:
 	virtual ~IEncodingDetector() = default;
 
-	virtual const char* Detect(const QString& text) const = 0;
+	virtual std::unique_ptr<ISession> CreateSession() const = 0;
 };
 
 struct Fb2EncodingParser
@@ -79,7 +89,16 @@ public:
 	virtual const QByteArray& GetInputFileBody() const noexcept = 0;
 };
 
-QString Validate(const Util::XmlValidator& validator, QByteArray& body);
-void    WriteErrorFile(const QDir& dir, std::mutex& guard, const QString& name, const QString& ext, const QByteArray& body);
+struct ValidationStatistics
+{
+	size_t wellFormed { 0 };
+	size_t validated { 0 };
+	size_t fixed { 0 };
+	size_t failed { 0 };
+};
+
+QString              Validate(const Util::XmlValidator& validator, QByteArray& body);
+void                 WriteErrorFile(const QDir& dir, std::mutex& guard, const QString& name, const QString& ext, const QByteArray& body);
+ValidationStatistics GetValidationStatistics();
 
 } // namespace HomeCompa::fb2cut
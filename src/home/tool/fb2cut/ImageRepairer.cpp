@@ -0,0 +1,200 @@
+#include "ImageRepairer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStringList>
+#include <QTemporaryDir>
+
+#include "StageStatistics.h"
+#include "log.h"
+
+using namespace HomeCompa::fb2cut;
+
+namespace
+{
+
+constexpr size_t MAX_BATCH_SIZE = 16;
+constexpr auto   BATCH_DELAY    = std::chrono::milliseconds(50);
+
+}
+
+ImageRepairer::ImageRepairer(QString ffmpeg, const int workerCount, const int timeout)
+	: m_ffmpeg { std::move(ffmpeg) }
+	, m_ffmpegFileName { QFileInfo(m_ffmpeg).fileName() }
+	, m_timeout { std::max(timeout, 1) }
+{
+	for (int i = 0, sz = std::max(workerCount, 1); i < sz; ++i)
+		m_threads.emplace_back(&ImageRepairer::Process, this);
+}
+
+ImageRepairer::~ImageRepairer()
+{
+	{
+		std::lock_guard lock(m_guard);
+		m_stopped = true;
+	}
+	m_condition.notify_all();
+
+	for (auto& thread : m_threads)
+		thread.join();
+
+	PLOGI << QString("ffmpeg repair: %1 of %2 images fixed, %3 processes launched").arg(m_fixedCount.load()).arg(m_requestCount.load()).arg(m_processCount.load());
+}
+
+std::future<QByteArray> ImageRepairer::Repair(QString imageFile, const QSize& maxSize, QByteArray body)
+{
+	Request request { .imageFile = std::move(imageFile), .maxSize = maxSize, .body = std::move(body) };
+	auto    result = request.result.get_future();
+	{
+		std::lock_guard lock(m_guard);
+		m_queue.push(std::move(request));
+	}
+	m_condition.notify_one();
+
+	return result;
+}
+
+void ImageRepairer::Process()
+{
+	while (true)
+	{
+		auto requests = Take();
+		if (requests.empty())
+			break;
+
+		m_requestCount += static_cast<int64_t>(requests.size());
+		if (Run(requests))
+			continue;
+
+		if (requests.size() > 1)
+			PLOGW << QString("%1 failed on a batch of %2 images, repairing them one by one").arg(m_ffmpegFileName).arg(requests.size());
+
+		for (auto& request : requests)
+		{
+			Requests single;
+			single.push_back(std::move(request));
+			if (requests.size() == 1 || !Run(single))
+				single.front().result.set_value({});
+		}
+	}
+}
+
+ImageRepairer::Requests ImageRepairer::Take()
+{
+	Requests result;
+
+	std::unique_lock lock(m_guard);
+	m_condition.wait(lock, [this] {
+		return m_stopped || !m_queue.empty();
+	});
+
+	if (m_queue.empty())
+		return result;
+
+	if (!m_stopped && m_queue.size() < MAX_BATCH_SIZE)
+		m_condition.wait_for(lock, BATCH_DELAY, [this] {
+			return m_stopped || m_queue.size() >= MAX_BATCH_SIZE;
+		});
+
+	while (!m_queue.empty() && result.size() < MAX_BATCH_SIZE)
+	{
+		result.push_back(std::move(m_queue.front()));
+		m_queue.pop();
+	}
+
+	return result;
+}
+
+bool ImageRepairer::Run(Requests& requests)
+{
+	StageTimer timer(Stage::Repair, std::accumulate(requests.begin(), requests.end(), qint64 { 0 }, [](const qint64 init, const Request& request) {
+		return init + request.body.size();
+	}));
+
+	const QTemporaryDir dir;
+	if (!dir.isValid())
+	{
+		PLOGE << "Cannot create temporary folder: " << dir.errorString();
+		return false;
+	}
+
+	auto args = QStringList() << "-hide_banner" << "-nostdin" << "-loglevel" << "error" << "-y";
+	for (size_t i = 0, sz = requests.size(); i < sz; ++i)
+	{
+		QFile file(dir.filePath(QString("%1.in").arg(i)));
+		if (!file.open(QIODevice::WriteOnly) || file.write(requests[i].body) != requests[i].body.size())
+			return false;
+
+		args << "-i" << file.fileName();
+	}
+
+	for (size_t i = 0, sz = requests.size(); i < sz; ++i)
+		args << "-map" << QString("%1:v:0").arg(i) << "-frames:v" << "1" << "-vf"
+			 << QString("scale='min(%1,iw)':min'(%2,ih)':force_original_aspect_ratio=decrease").arg(requests[i].maxSize.width()).arg(requests[i].maxSize.height()) << "-f" << "mjpeg"
+			 << dir.filePath(QString("%1.jpg").arg(i));
+
+	const auto imageFiles = [&] {
+		QStringList result;
+		for (const auto& request : requests)
+			result << request.imageFile;
+		return result.join(", ");
+	}();
+
+	QProcess process;
+	process.start(m_ffmpeg, args, QIODevice::ReadOnly);
+	++m_processCount;
+	if (!process.waitForStarted())
+	{
+		PLOGE << QString("Cannot launch %1: %2").arg(m_ffmpegFileName, process.errorString());
+		return false;
+	}
+
+	PLOGI << QString("%1 launched for %2").arg(m_ffmpegFileName, imageFiles);
+
+	if (!process.waitForFinished(m_timeout * 1000 * static_cast<int>(requests.size())))
+	{
+		process.kill();
+		process.waitForFinished();
+		PLOGW << QString("Cannot fix %1, %2 timed out").arg(imageFiles, m_ffmpegFileName);
+		return false;
+	}
+
+	if (const auto errors = process.readAllStandardError(); !errors.isEmpty())
+		PLOGW << "\n" << errors;
+
+	if (process.exitStatus() != QProcess::NormalExit || process.exitCode() != 0)
+	{
+		PLOGW << QString("Cannot fix %1, %2 finished with %3").arg(imageFiles, m_ffmpegFileName).arg(process.exitCode());
+		return false;
+	}
+
+	std::vector<QByteArray> fixed;
+	fixed.reserve(requests.size());
+	for (size_t i = 0, sz = requests.size(); i < sz; ++i)
+	{
+		QFile file(dir.filePath(QString("%1.jpg").arg(i)));
+		if (!file.open(QIODevice::ReadOnly))
+			return false;
+
+		if (fixed.emplace_back(file.readAll()).isEmpty())
+			return false;
+	}
+
+	timer.SetBytesOut(std::accumulate(fixed.begin(), fixed.end(), qint64 { 0 }, [](const qint64 init, const QByteArray& body) {
+		return init + body.size();
+	}));
+
+	for (size_t i = 0, sz = requests.size(); i < sz; ++i)
+	{
+		PLOGI << QString("%1 is probably fixed").arg(requests[i].imageFile);
+		requests[i].result.set_value(std::move(fixed[i]));
+	}
+	m_fixedCount += static_cast<int64_t>(requests.size());
+
+	return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include <QByteArray>
+#include <QSize>
+#include <QString>
+
+#include "fnd/NonCopyMovable.h"
+
+namespace HomeCompa::fb2cut
+{
+
+class ImageRepairer
+{
+	NON_COPY_MOVABLE(ImageRepairer)
+
+public:
+	ImageRepairer(QString ffmpeg, int workerCount, int timeout);
+	~ImageRepairer();
+
+public:
+	std::future<QByteArray> Repair(QString imageFile, const QSize& maxSize, QByteArray body);
+
+private:
+	struct Request
+	{
+		QString                  imageFile;
+		QSize                    maxSize;
+		QByteArray               body;
+		std::promise<QByteArray> result;
+	};
+
+	using Requests = std::vector<Request>;
+
+private:
+	void     Process();
+	Requests Take();
+	bool     Run(Requests& requests);
+
+private:
+	const QString m_ffmpeg;
+	const QString m_ffmpegFileName;
+	const int     m_timeout;
+
+	std::mutex              m_guard;
+	std::condition_variable m_condition;
+	std::queue<Request>     m_queue;
+	bool                    m_stopped { false };
+
+	std::atomic_int64_t m_processCount { 0 };
+	std::atomic_int64_t m_requestCount { 0 };
+	std::atomic_int64_t m_fixedCount { 0 };
+
+	std::vector<std::thread> m_threads;
+};
+
+} // namespace HomeCompa::fb2cut
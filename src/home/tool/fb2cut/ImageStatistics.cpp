@@ -0,0 +1,153 @@
+#include "ImageStatistics.h"
+
+#include <QTextStream>
+
+#include "database/interface/ICommand.h"
+#include "database/interface/IDatabase.h"
+#include "database/interface/ITransaction.h"
+
+#include "lib/Hash.h"
+#include "lib/ImageStatisticsDatabase.h"
+
+#include "Journal.h"
+#include "log.h"
+#include "settings.h"
+
+using namespace HomeCompa;
+using namespace HomeCompa::fb2cut;
+
+namespace
+{
+
+constexpr auto HASH_ALGORITHM_HEADER = "#HASH_ALGORITHM|";
+
+QString ReadHashAlgorithm(const QString& fileName)
+{
+	QString result = FliLib::HASH_MD5;
+	QFile   file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+		return result;
+
+	QTextStream stream(&file);
+	QString     line;
+	while (stream.readLineInto(&line) && line.startsWith('#'))
+		if (line.startsWith(HASH_ALGORITHM_HEADER))
+			result = line.mid(QString(HASH_ALGORITHM_HEADER).size()).trimmed();
+
+	return result;
+}
+
+void Bind(DB::ICommand& command, const size_t index, const QString& value)
+{
+	if (value.isEmpty())
+		command.Bind(index);
+	else
+		command.Bind(index, value.toStdString());
+}
+
+template <typename T>
+void Bind(DB::ICommand& command, const size_t index, const T value, const T nullValue = 0)
+{
+	if (value == nullValue)
+		command.Bind(index);
+	else
+		command.Bind(index, value);
+}
+
+}
+
+ImageStatisticsWriter::ImageStatisticsWriter(const Settings& settings, Journal& journal)
+	: m_resume { settings.resume }
+	, m_file { settings.imageStatistics }
+{
+	if (!settings.imageStatistics.isEmpty())
+	{
+		if (settings.resume && journal.GetStatisticsOffset() >= 0 && m_file.exists() && !m_file.resize(journal.GetStatisticsOffset()))
+			throw std::ios_base::failure(QString("Cannot truncate %1").arg(settings.imageStatistics).toStdString());
+		if (m_file.exists() && m_file.size() > 0)
+			if (const auto hashAlgorithm = ReadHashAlgorithm(settings.imageStatistics); hashAlgorithm != settings.hashAlgorithm)
+				throw std::invalid_argument(QString("%1 uses hash algorithm %2, cannot append %3 hashes").arg(settings.imageStatistics, hashAlgorithm, settings.hashAlgorithm).toStdString());
+		if (!m_file.open(QIODevice::Append))
+			throw std::ios_base::failure(QString("Cannot write to %1").arg(settings.imageStatistics).toStdString());
+		m_stream = std::make_unique<QTextStream>(&m_file);
+		if (m_file.size() == 0)
+		{
+			*m_stream << HASH_ALGORITHM_HEADER << settings.hashAlgorithm << "\n";
+			*m_stream << "#ARCHIVE|FB2_FILE|IMAGE_ID|FAIL_INFO|IS_COVER|PIXEL_TYPE|IMAGE_FILE_SIZE|WIDTH|HEIGHT|HASH\n";
+			m_stream->flush();
+		}
+		journal.SetStatisticsOffset(m_file.size());
+	}
+
+	if (!settings.imageStatisticsDb.isEmpty())
+		m_db = FliLib::CreateImageStatisticsDatabase(settings.imageStatisticsDb, settings.hashAlgorithm);
+}
+
+ImageStatisticsWriter::~ImageStatisticsWriter()
+{
+	if (!m_db)
+		return;
+
+	PLOGI << "image statistics database: " << m_dbRowCount << " rows inserted";
+
+	try
+	{
+		FliLib::CreateImageStatisticsIndices(*m_db);
+	}
+	catch (const std::exception& ex)
+	{
+		PLOGE << ex.what();
+	}
+}
+
+qint64 ImageStatisticsWriter::Write(const QString& folder, ImageStatistics imageStatistics)
+{
+	if (m_stream)
+		WriteText(imageStatistics);
+
+	// the journal records the archive as done right after this returns, so its rows must be committed by then
+	if (m_db)
+		WriteDatabase(folder, imageStatistics);
+
+	return m_stream ? m_file.size() : -1;
+}
+
+void ImageStatisticsWriter::WriteText(const ImageStatistics& imageStatistics) const
+{
+	for (const auto& [folder, fileName, imageId, fail, isCover, size, width, height, schema, hash] : imageStatistics)
+		(*m_stream) << folder << '|' << fileName << '|' << imageId << '|' << fail << '|' << (isCover ? 1 : 0) << '|' << static_cast<int>(schema) << '|' << size << '|' << width << '|' << height << '|' << hash << '\n';
+
+	m_stream->flush();
+}
+
+void ImageStatisticsWriter::WriteDatabase(const QString& folder, const ImageStatistics& imageStatistics)
+{
+	const auto tr = m_db->CreateTransaction();
+
+	if (m_resume)
+	{
+		const auto command = tr->CreateCommand(FliLib::DELETE_IMAGE_STATISTICS);
+		command->Bind(0, folder.toStdString());
+		command->Execute();
+	}
+
+	const auto command = tr->CreateCommand(FliLib::INSERT_IMAGE_STATISTICS);
+	for (const auto& [itemFolder, fileName, imageId, fail, isCover, size, width, height, schema, hash] : imageStatistics)
+	{
+		command->Bind(0, itemFolder.toStdString());
+		command->Bind(1, fileName.toStdString());
+		command->Bind(2, imageId.toStdString());
+		Bind(*command, 3, fail);
+		command->Bind(4, isCover ? 1 : 0);
+		Bind(*command, 5, static_cast<int>(schema), -1);
+		Bind(*command, 6, static_cast<long long>(size));
+		Bind(*command, 7, width);
+		Bind(*command, 8, height);
+		command->Bind(9, hash.toStdString());
+		if (!command->Execute())
+			PLOGE << "image statistics database: cannot insert " << fileName << "/" << imageId;
+	}
+
+	tr->Commit();
+	m_dbRowCount += static_cast<int64_t>(imageStatistics.size());
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <QFile>
+#include <QString>
+
+#include "fnd/NonCopyMovable.h"
+
+class QTextStream;
+
+namespace HomeCompa::DB
+{
+
+class IDatabase;
+
+}
+
+namespace HomeCompa::fb2cut
+{
+
+class Journal;
+struct Settings;
+
+struct ImageStatisticsItem
+{
+	enum class PixelSchema
+	{
+		Unknown = -1,
+		Normal,
+		GrayScale,
+		Alpha,
+	};
+	QString     folder;
+	QString     fileName;
+	QString     imageId;
+	QString     fail;
+	bool        isCover { false };
+	qsizetype   size { 0 };
+	int         width { 0 };
+	int         height { 0 };
+	PixelSchema schema { PixelSchema::Unknown };
+	QString     hash;
+};
+
+using ImageStatistics = std::vector<ImageStatisticsItem>;
+
+class ImageStatisticsWriter
+{
+	NON_COPY_MOVABLE(ImageStatisticsWriter)
+
+public:
+	ImageStatisticsWriter(const Settings& settings, Journal& journal);
+	~ImageStatisticsWriter();
+
+public:
+	qint64 Write(const QString& folder, ImageStatistics imageStatistics);
+
+private:
+	void WriteText(const ImageStatistics& imageStatistics) const;
+	void WriteDatabase(const QString& folder, const ImageStatistics& imageStatistics);
+
+private:
+	const bool                     m_resume;
+	QFile                          m_file;
+	std::unique_ptr<QTextStream>   m_stream;
+	std::unique_ptr<DB::IDatabase> m_db;
+	std::atomic_int64_t            m_dbRowCount { 0 };
+};
+
+} // namespace HomeCompa::fb2cut
@@ -0,0 +1,135 @@
+#include "Journal.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <QDateTime>
+#include <QFileInfo>
+
+#include "log.h"
+
+using namespace HomeCompa::fb2cut;
+
+namespace
+{
+
+constexpr auto JOURNAL_FILE_NAME = "fb2cut.journal";
+constexpr auto ARCHIVE           = "archive";
+constexpr auto STATISTICS        = "statistics";
+
+bool Sync(const QFile& file)
+{
+#ifdef _WIN32
+	return _commit(file.handle()) == 0;
+#else
+	return fsync(file.handle()) == 0;
+#endif
+}
+
+}
+
+Journal::Journal(const QDir& dstDir, const bool resume)
+	: m_dstDir { dstDir }
+	, m_file { dstDir.filePath(JOURNAL_FILE_NAME) }
+{
+	if (resume)
+		Load();
+
+	if (!m_file.open(resume ? QIODevice::Append : QIODevice::WriteOnly | QIODevice::Truncate))
+		throw std::ios_base::failure(QString("Cannot write to %1").arg(m_file.fileName()).toStdString());
+}
+
+Journal::~Journal() = default;
+
+std::optional<bool> Journal::IsCompleted(const QString& archive) const
+{
+	std::lock_guard lock(m_guard);
+	const auto      it = m_items.find(GetKey(archive));
+	if (it == m_items.end())
+		return std::nullopt;
+
+	for (const auto& output : it->second.outputs)
+	{
+		if (const QFileInfo fileInfo(m_dstDir.filePath(output.fileName)); !fileInfo.exists() || fileInfo.size() != output.size || fileInfo.lastModified().toMSecsSinceEpoch() != output.modified)
+		{
+			PLOGW << QString("%1 is completed in journal but %2 is missing or changed").arg(archive, output.fileName);
+			return std::nullopt;
+		}
+	}
+
+	return it->second.hasError;
+}
+
+qint64 Journal::GetStatisticsOffset() const noexcept
+{
+	return m_statisticsOffset;
+}
+
+void Journal::SetStatisticsOffset(const qint64 offset)
+{
+	std::lock_guard lock(m_guard);
+	m_statisticsOffset = offset;
+	Append({ STATISTICS, QString::number(offset) });
+}
+
+void Journal::Commit(const QString& archive, const bool hasError, const QStringList& outputFiles, const StatisticsWriter& statisticsWriter)
+{
+	QStringList outputs;
+	for (const auto& fileName : outputFiles)
+		if (const QFileInfo fileInfo(fileName); fileInfo.exists())
+			outputs << m_dstDir.relativeFilePath(fileName) << QString::number(fileInfo.size()) << QString::number(fileInfo.lastModified().toMSecsSinceEpoch());
+
+	std::lock_guard lock(m_guard);
+	if (const auto offset = statisticsWriter(); offset >= 0)
+		m_statisticsOffset = offset;
+
+	Append(QStringList { ARCHIVE, GetKey(archive), QString::number(hasError ? 1 : 0), QString::number(m_statisticsOffset) } << outputs);
+}
+
+QString Journal::GetKey(const QString& archive) const
+{
+	return m_dstDir.relativeFilePath(QFileInfo(archive).absoluteFilePath());
+}
+
+void Journal::Load()
+{
+	if (!m_file.open(QIODevice::ReadOnly))
+		return;
+
+	while (!m_file.atEnd())
+	{
+		const auto line = QString::fromUtf8(m_file.readLine()).trimmed();
+		if (!line.endsWith('|'))
+			continue;
+
+		const auto values = line.chopped(1).split('|');
+		if (values.size() == 2 && values.front() == STATISTICS)
+		{
+			m_statisticsOffset = values.back().toLongLong();
+			continue;
+		}
+
+		if (values.size() < 4 || values.front() != ARCHIVE || (values.size() - 4) % 3 != 0)
+			continue;
+
+		Item item { .hasError = values[2] == "1" };
+		for (qsizetype i = 4; i < values.size(); i += 3)
+			item.outputs.emplace_back(values[i], values[i + 1].toLongLong(), values[i + 2].toLongLong());
+
+		m_statisticsOffset = values[3].toLongLong();
+		m_items[values[1]] = std::move(item);
+	}
+
+	m_file.close();
+
+	PLOGI << QString("journal %1: %2 archives completed").arg(m_file.fileName()).arg(m_items.size());
+}
+
+void Journal::Append(const QStringList& values)
+{
+	if (m_file.write(values.join('|').append("|\n").toUtf8()) < 0 || !m_file.flush() || !Sync(m_file))
+		PLOGE << "cannot write to " << m_file.fileName();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+#include <QDir>
+#include <QFile>
+#include <QStringList>
+
+#include "fnd/NonCopyMovable.h"
+
+namespace HomeCompa::fb2cut
+{
+
+class Journal
+{
+	NON_COPY_MOVABLE(Journal)
+
+public:
+	using StatisticsWriter = std::function<qint64()>;
+
+public:
+	Journal(const QDir& dstDir, bool resume);
+	~Journal();
+
+public:
+	std::optional<bool> IsCompleted(const QString& archive) const;
+	qint64              GetStatisticsOffset() const noexcept;
+	void                SetStatisticsOffset(qint64 offset);
+	void                Commit(const QString& archive, bool hasError, const QStringList& outputFiles, const StatisticsWriter& statisticsWriter);
+
+private:
+	struct Output
+	{
+		QString fileName;
+		qint64  size { -1 };
+		qint64  modified { 0 };
+	};
+
+	struct Item
+	{
+		bool                hasError { false };
+		std::vector<Output> outputs;
+	};
+
+private:
+	QString GetKey(const QString& archive) const;
+	void    Load();
+	void    Append(const QStringList& values);
+
+private:
+	const QDir                        m_dstDir;
+	QFile                             m_file;
+	std::unordered_map<QString, Item> m_items;
+	qint64                            m_statisticsOffset { -1 };
+	mutable std::mutex                m_guard;
+};
+
+} // namespace HomeCompa::fb2cut
@@ -1,3 +1,6 @@
+#include <array>
+#include <cstdlib>
+
 #include <QBuffer>
 #include <QDir>
 #include <QFileInfo>
@@ -161,20 +164,63 @@ class EncodingDetector final : virtual public IEncodingDetector
 #undef ITEM
 	};
 
-private: // IEncodingDetector
-	const char* Detect(const QString& text) const override
+	static constexpr qsizetype MIN_SAMPLE_SIZE = 4 * 1024;
+	static constexpr qsizetype MAX_SAMPLE_SIZE = 1024 * 1024;
+
+	class Session final : public ISession
 	{
-		qsizetype counters[std::size(ENCODINGS)] {};
-		for (const auto ch : text)
+	public:
+		explicit Session(const std::vector<uint8_t>& unicodeTable)
+			: m_unicodeTable { unicodeTable }
+		{
+		}
+
+	private: // ISession
+		bool Add(const QStringView text) override
+		{
+			if (m_finished)
+				return false;
+
+			const auto sample = text.first(std::min(text.size(), MAX_SAMPLE_SIZE - m_size));
+			for (const auto ch : sample)
+			{
+				const auto u = ch.unicode();
+				for (const auto i : std::views::iota(uint8_t { 0 }, static_cast<uint8_t>(std::size(ENCODINGS))))
+					if (m_unicodeTable[u] & (uint8_t { 1 } << i))
+						++m_counters[i];
+			}
+			m_size += sample.size();
+
+			return !(m_finished = m_size >= MAX_SAMPLE_SIZE || (m_size >= MIN_SAMPLE_SIZE && IsConfident()));
+		}
+
+		const char* GetEncoding() const override
 		{
-			const auto u = ch.unicode();
-			for (const auto i : std::views::iota(uint8_t { 0 }, static_cast<uint8_t>(std::size(ENCODINGS))))
-				if (m_unicodeTable[u] & (uint8_t { 1 } << i))
-					++counters[i];
+			const auto it = std::ranges::max_element(m_counters);
+			return *it * 6 < 5 * m_size ? UTF8 : ENCODINGS[std::distance(std::begin(m_counters), it)].first;
 		}
 
-		const auto it = std::ranges::max_element(counters);
-		return *it * 6 < 5 * text.size() ? UTF8 : ENCODINGS[std::distance(std::begin(counters), it)].first;
+	private:
+		bool IsConfident() const
+		{
+			auto counters = std::to_array(m_counters);
+			std::ranges::partial_sort(counters, counters.begin() + 2, std::greater {});
+
+			const auto margin = m_size / 16;
+			return counters[0] - counters[1] >= margin && std::abs(counters[0] * 6 - m_size * 5) >= margin * 6;
+		}
+
+	private:
+		const std::vector<uint8_t>& m_unicodeTable;
+		qsizetype                   m_counters[std::size(ENCODINGS)] {};
+		qsizetype                   m_size { 0 };
+		bool                        m_finished { false };
+	};
+
+private: // IEncodingDetector
+	std::unique_ptr<ISession> CreateSession() const override
+	{
+		return std::make_unique<Session>(m_unicodeTable);
 	}
 
 private:
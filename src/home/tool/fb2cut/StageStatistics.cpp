@@ -0,0 +1,241 @@
+#include "StageStatistics.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <ctime>
+#endif
+
+#include <QJsonDocument>
+#include <QJsonObject>
+
+using namespace HomeCompa::fb2cut;
+
+namespace
+{
+
+constexpr const char* STAGE_NAMES[] {
+#define STAGE_ITEM(NAME) #NAME,
+	STAGE_ITEMS_X_MACRO
+#undef STAGE_ITEM
+};
+static_assert(std::size(STAGE_NAMES) == StageStatistics::STAGE_COUNT);
+
+thread_local StageTimer* g_currentTimer = nullptr;
+
+uint64_t GetWallTime() noexcept
+{
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+uint64_t GetThreadCpuTime() noexcept
+{
+#ifdef _WIN32
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (!GetThreadTimes(GetCurrentThread(), &creationTime, &exitTime, &kernelTime, &userTime))
+		return 0;
+
+	const auto toNanoseconds = [](const FILETIME& time) {
+		return ((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 100;
+	};
+	return toNanoseconds(kernelTime) + toNanoseconds(userTime);
+#else
+	timespec time {};
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) != 0)
+		return 0;
+
+	return static_cast<uint64_t>(time.tv_sec) * 1'000'000'000ULL + static_cast<uint64_t>(time.tv_nsec);
+#endif
+}
+
+size_t GetBucket(const uint64_t value) noexcept
+{
+	if (value < 4)
+		return static_cast<size_t>(value);
+
+	const auto exponent = static_cast<size_t>(std::bit_width(value)) - 1;
+	return exponent * 4 + static_cast<size_t>((value >> (exponent - 2)) & 3);
+}
+
+uint64_t GetBucketValue(const size_t bucket) noexcept
+{
+	if (bucket < 4)
+		return bucket;
+
+	return (4ULL + bucket % 4) << (bucket / 4 - 2);
+}
+
+double ToSeconds(const uint64_t value)
+{
+	return static_cast<double>(value) / 1e9;
+}
+
+double ToMilliseconds(const uint64_t value)
+{
+	return static_cast<double>(value) / 1e6;
+}
+
+double ToMegabytes(const uint64_t value)
+{
+	return static_cast<double>(value) / 1024.0 / 1024.0;
+}
+
+}
+
+uint64_t StageStatistics::Item::GetPercentile(const size_t percent) const noexcept
+{
+	if (count == 0)
+		return 0;
+
+	const auto threshold = std::max<uint64_t>((count * percent + 99) / 100, 1);
+	uint64_t   total     = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; ++i)
+		if (total += buckets[i]; total >= threshold)
+			return GetBucketValue(i);
+
+	return GetBucketValue(BUCKET_COUNT - 1);
+}
+
+void StageStatistics::Add(const Stage stage, const uint64_t wallTime, const uint64_t cpuTime, const uint64_t bytesIn, const uint64_t bytesOut) noexcept
+{
+	auto& counters = m_counters[static_cast<size_t>(stage)];
+	counters.count.fetch_add(1, std::memory_order_relaxed);
+	counters.wallTime.fetch_add(wallTime, std::memory_order_relaxed);
+	counters.cpuTime.fetch_add(cpuTime, std::memory_order_relaxed);
+	counters.bytesIn.fetch_add(bytesIn, std::memory_order_relaxed);
+	counters.bytesOut.fetch_add(bytesOut, std::memory_order_relaxed);
+	counters.buckets[GetBucket(wallTime)].fetch_add(1, std::memory_order_relaxed);
+}
+
+StageStatistics::Snapshot StageStatistics::GetSnapshot() const noexcept
+{
+	Snapshot result;
+	for (size_t i = 0; i < STAGE_COUNT; ++i)
+	{
+		const auto& counters = m_counters[i];
+		auto&       item     = result[i];
+
+		item.count    = counters.count.load(std::memory_order_relaxed);
+		item.wallTime = counters.wallTime.load(std::memory_order_relaxed);
+		item.cpuTime  = counters.cpuTime.load(std::memory_order_relaxed);
+		item.bytesIn  = counters.bytesIn.load(std::memory_order_relaxed);
+		item.bytesOut = counters.bytesOut.load(std::memory_order_relaxed);
+		for (size_t j = 0; j < BUCKET_COUNT; ++j)
+			item.buckets[j] = counters.buckets[j].load(std::memory_order_relaxed);
+	}
+	return result;
+}
+
+StageStatistics::Snapshot StageStatistics::Subtract(const Snapshot& lhs, const Snapshot& rhs) noexcept
+{
+	Snapshot result;
+	for (size_t i = 0; i < STAGE_COUNT; ++i)
+	{
+		auto& item = result[i];
+
+		item.count    = lhs[i].count - rhs[i].count;
+		item.wallTime = lhs[i].wallTime - rhs[i].wallTime;
+		item.cpuTime  = lhs[i].cpuTime - rhs[i].cpuTime;
+		item.bytesIn  = lhs[i].bytesIn - rhs[i].bytesIn;
+		item.bytesOut = lhs[i].bytesOut - rhs[i].bytesOut;
+		for (size_t j = 0; j < BUCKET_COUNT; ++j)
+			item.buckets[j] = lhs[i].buckets[j] - rhs[i].buckets[j];
+	}
+	return result;
+}
+
+QString StageStatistics::ToString(const Snapshot& snapshot)
+{
+	QString result = QString("%1 %2 %3 %4 %5 %6 %7 %8")
+	                     .arg("stage", -14)
+	                     .arg("items", 10)
+	                     .arg("wall, s", 10)
+	                     .arg("cpu, s", 10)
+	                     .arg("in, MB", 10)
+	                     .arg("out, MB", 10)
+	                     .arg("p50, ms", 10)
+	                     .arg("p99, ms", 10);
+
+	for (size_t i = 0; i < STAGE_COUNT; ++i)
+	{
+		const auto& item = snapshot[i];
+		if (item.count == 0)
+			continue;
+
+		result.append(QString("\n%1 %2 %3 %4 %5 %6 %7 %8")
+		                  .arg(STAGE_NAMES[i], -14)
+		                  .arg(item.count, 10)
+		                  .arg(ToSeconds(item.wallTime), 10, 'f', 2)
+		                  .arg(ToSeconds(item.cpuTime), 10, 'f', 2)
+		                  .arg(ToMegabytes(item.bytesIn), 10, 'f', 1)
+		                  .arg(ToMegabytes(item.bytesOut), 10, 'f', 1)
+		                  .arg(ToMilliseconds(item.GetPercentile(50)), 10, 'f', 3)
+		                  .arg(ToMilliseconds(item.GetPercentile(99)), 10, 'f', 3));
+	}
+
+	return result;
+}
+
+QByteArray StageStatistics::ToJson(const Snapshot& snapshot)
+{
+	QJsonObject stages;
+	for (size_t i = 0; i < STAGE_COUNT; ++i)
+	{
+		const auto& item = snapshot[i];
+		if (item.count == 0)
+			continue;
+
+		stages.insert(STAGE_NAMES[i],
+		               QJsonObject {
+						   { "count", static_cast<qint64>(item.count) },
+						   { "wallTimeNs", static_cast<qint64>(item.wallTime) },
+						   { "cpuTimeNs", static_cast<qint64>(item.cpuTime) },
+						   { "bytesIn", static_cast<qint64>(item.bytesIn) },
+						   { "bytesOut", static_cast<qint64>(item.bytesOut) },
+						   { "p50Ns", static_cast<qint64>(item.GetPercentile(50)) },
+						   { "p99Ns", static_cast<qint64>(item.GetPercentile(99)) },
+					   });
+	}
+
+	return QJsonDocument(QJsonObject { { "stages", stages } }).toJson();
+}
+
+StageStatistics& HomeCompa::fb2cut::GetStageStatistics()
+{
+	static StageStatistics statistics;
+	return statistics;
+}
+
+StageTimer::StageTimer(const Stage stage, const qint64 bytesIn) noexcept
+	: m_stage { stage }
+	, m_bytesIn { static_cast<uint64_t>(bytesIn) }
+	, m_wallStart { GetWallTime() }
+	, m_cpuStart { GetThreadCpuTime() }
+	, m_parent { g_currentTimer }
+{
+	g_currentTimer = this;
+}
+
+StageTimer::~StageTimer()
+{
+	g_currentTimer = m_parent;
+
+	const auto wallTime = GetWallTime() - m_wallStart;
+	const auto cpuTime  = GetThreadCpuTime() - m_cpuStart;
+	if (m_parent)
+	{
+		m_parent->m_childWallTime += wallTime;
+		m_parent->m_childCpuTime  += cpuTime;
+	}
+
+	GetStageStatistics().Add(m_stage, wallTime - std::min(wallTime, m_childWallTime), cpuTime - std::min(cpuTime, m_childCpuTime), m_bytesIn, m_bytesOut);
+}
+
+void StageTimer::SetBytesOut(const qint64 bytesOut) noexcept
+{
+	m_bytesOut = static_cast<uint64_t>(bytesOut);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <QByteArray>
+#include <QString>
+
+#include "fnd/NonCopyMovable.h"
+
+namespace HomeCompa::fb2cut
+{
+
+#define STAGE_ITEMS_X_MACRO   \
+	STAGE_ITEM(ZipRead)       \
+	STAGE_ITEM(Decode)        \
+	STAGE_ITEM(Validation)    \
+	STAGE_ITEM(FixInput)      \
+	STAGE_ITEM(Parse)         \
+	STAGE_ITEM(ImageDecode)   \
+	STAGE_ITEM(Scale)         \
+	STAGE_ITEM(Encode)        \
+	STAGE_ITEM(Transcode)     \
+	STAGE_ITEM(Repair)        \
+	STAGE_ITEM(ArchiveImages) \
+	STAGE_ITEM(ArchiveFb2)
+
+enum class Stage
+{
+#define STAGE_ITEM(NAME) NAME,
+	STAGE_ITEMS_X_MACRO
+#undef STAGE_ITEM
+	Last
+};
+
+class StageStatistics
+{
+	NON_COPY_MOVABLE(StageStatistics)
+
+public:
+	static constexpr size_t STAGE_COUNT  = static_cast<size_t>(Stage::Last);
+	static constexpr size_t BUCKET_COUNT = 256;
+
+	struct Item
+	{
+		uint64_t                           count { 0 };
+		uint64_t                           wallTime { 0 };
+		uint64_t                           cpuTime { 0 };
+		uint64_t                           bytesIn { 0 };
+		uint64_t                           bytesOut { 0 };
+		std::array<uint64_t, BUCKET_COUNT> buckets {};
+
+		uint64_t GetPercentile(size_t percent) const noexcept;
+	};
+
+	using Snapshot = std::array<Item, STAGE_COUNT>;
+
+public:
+	StageStatistics()  = default;
+	~StageStatistics() = default;
+
+public:
+	void     Add(Stage stage, uint64_t wallTime, uint64_t cpuTime, uint64_t bytesIn, uint64_t bytesOut) noexcept;
+	Snapshot GetSnapshot() const noexcept;
+
+	static Snapshot   Subtract(const Snapshot& lhs, const Snapshot& rhs) noexcept;
+	static QString    ToString(const Snapshot& snapshot);
+	static QByteArray ToJson(const Snapshot& snapshot);
+
+private:
+	struct Counters
+	{
+		std::atomic_uint64_t                           count { 0 };
+		std::atomic_uint64_t                           wallTime { 0 };
+		std::atomic_uint64_t                           cpuTime { 0 };
+		std::atomic_uint64_t                           bytesIn { 0 };
+		std::atomic_uint64_t                           bytesOut { 0 };
+		std::array<std::atomic_uint64_t, BUCKET_COUNT> buckets {};
+	};
+
+	std::array<Counters, STAGE_COUNT> m_counters;
+};
+
+StageStatistics& GetStageStatistics();
+
+class StageTimer
+{
+	NON_COPY_MOVABLE(StageTimer)
+
+public:
+	explicit StageTimer(Stage stage, qint64 bytesIn = 0) noexcept;
+	~StageTimer();
+
+public:
+	void SetBytesOut(qint64 bytesOut) noexcept;
+
+private:
+	const Stage    m_stage;
+	const uint64_t m_bytesIn;
+	uint64_t       m_bytesOut { 0 };
+	const uint64_t m_wallStart;
+	const uint64_t m_cpuStart;
+	uint64_t       m_childWallTime { 0 };
+	uint64_t       m_childCpuTime { 0 };
+	StageTimer*    m_parent;
+};
+
+} // namespace HomeCompa::fb2cut
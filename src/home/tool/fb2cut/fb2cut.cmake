@@ -9,6 +9,7 @@ AddTarget(fb2cut	app_console
 		Qt${QT_MAJOR_VERSION}::Gui
 		Qt${QT_MAJOR_VERSION}::Svg
 	LINK_TARGETS
+		dbfactory
 		flicu
 		fljxl
 		lib
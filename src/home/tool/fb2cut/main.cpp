@@ -1,11 +1,12 @@
+#include <chrono>
 #include <condition_variable>
 #include <expected>
-#include <queue>
+#include <numeric>
+#include <optional>
 #include <ranges>
 
 #include <QBuffer>
 #include <QCommandLineParser>
-#include <QCryptographicHash>
 #include <QDirIterator>
 #include <QGuiApplication>
 #include <QImageReader>
@@ -26,18 +27,33 @@
 #include "fnd/algorithm.h"
 
 #include "jxl/jxl.h"
+#include "lib/ArchiveManifest.h"
+#include "lib/ArchiveReader.h"
+#include "lib/ArchiveWriter.h"
+#include "lib/Hash.h"
 #include "lib/ImageItem.h"
+#include "lib/ImageReader.h"
+#include "lib/JpegTranscoder.h"
+#include "lib/PixelKernels.h"
+#include "lib/WorkQueue.h"
 #include "lib/book.h"
 #include "logging/LogAppender.h"
 #include "logging/init.h"
 #include "util/ImageUtil.h"
 #include "util/LogConsoleFormatter.h"
+#include "util/executor/ThreadPool.h"
 #include "util/files.h"
 #include "util/progress.h"
 #include "util/xml/Initializer.h"
 #include "util/xml/Validator.h"
 
+#include "EncodeCache.h"
+#include "EncodePredictor.h"
 #include "IParser.h"
+#include "ImageStatistics.h"
+#include "ImageRepairer.h"
+#include "Journal.h"
+#include "StageStatistics.h"
 #include "log.h"
 #include "settings.h"
 #include "zip.h"
@@ -66,15 +82,31 @@ constexpr auto IMAGE_GRAYSCALE_OPTION_NAME      = "image-grayscale";
 constexpr auto ARCHIVER_OPTION_NAME             = "archiver";
 constexpr auto ARCHIVER_COMMANDLINE_OPTION_NAME = "archiver-options";
 
-constexpr auto MAX_THREAD_COUNT_OPTION_NAME    = "threads";
-constexpr auto NO_ARCHIVE_FB2_OPTION_NAME      = "no-archive-fb2";
-constexpr auto NO_FB2_OPTION_NAME              = "no-fb2";
-constexpr auto NO_IMAGES_OPTION_NAME           = "no-images";
-constexpr auto COVERS_ONLY_OPTION_NAME         = "covers-only";
-constexpr auto FFMPEG_OPTION_NAME              = "ffmpeg";
-constexpr auto MIN_IMAGE_FILE_SIZE_OPTION_NAME = "min-image-file-size";
-constexpr auto FORMAT                          = "format";
-constexpr auto IMAGE_STATISTICS                = "image-statistics";
+constexpr auto MAX_THREAD_COUNT_OPTION_NAME           = "threads";
+constexpr auto ENCODER_THREAD_COUNT_OPTION_NAME       = "encoder-threads";
+constexpr auto BACKGROUND_ARCHIVES_OPTION_NAME        = "background-archives";
+constexpr auto BACKGROUND_ARCHIVES_MEMORY_OPTION_NAME = "background-archives-memory";
+constexpr auto FB2_MEMORY_LIMIT_OPTION_NAME           = "fb2-memory";
+constexpr auto MEMORY_BUDGET_OPTION_NAME              = "memory-budget";
+constexpr auto NO_ARCHIVE_FB2_OPTION_NAME             = "no-archive-fb2";
+constexpr auto NO_FB2_OPTION_NAME                     = "no-fb2";
+constexpr auto NO_IMAGES_OPTION_NAME                  = "no-images";
+constexpr auto COVERS_ONLY_OPTION_NAME                = "covers-only";
+constexpr auto JPEG_TRANSCODE_OPTION_NAME             = "jpeg-transcode";
+constexpr auto FFMPEG_OPTION_NAME                     = "ffmpeg";
+constexpr auto FFMPEG_WORKERS_OPTION_NAME             = "ffmpeg-workers";
+constexpr auto FFMPEG_TIMEOUT_OPTION_NAME             = "ffmpeg-timeout";
+constexpr auto MIN_IMAGE_FILE_SIZE_OPTION_NAME        = "min-image-file-size";
+constexpr auto FORMAT                                 = "format";
+constexpr auto IMAGE_STATISTICS                       = "image-statistics";
+constexpr auto IMAGE_STATISTICS_DB                    = "image-statistics-db";
+constexpr auto STAGE_STATISTICS                       = "stage-statistics";
+constexpr auto ENCODE_CACHE                           = "encode-cache";
+constexpr auto ENCODE_CACHE_SIZE                      = "encode-cache-size";
+constexpr auto ENCODE_HISTORY                         = "encode-history";
+constexpr auto ENCODE_CALIBRATION                     = "encode-calibration";
+constexpr auto HASH_ALGORITHM_OPTION_NAME             = "hash";
+constexpr auto RESUME                                 = "resume";
 
 constexpr auto QUALITY     = "quality [-1]";
 constexpr auto THREADS     = "threads [%1]";
@@ -83,6 +115,9 @@ constexpr auto PATH        = "path";
 constexpr auto COMMANDLINE = "list of options";
 constexpr auto SIZE        = "size [INT_MAX,INT_MAX]";
 
+constexpr auto SPILL_FOLDER       = "spill";
+constexpr auto REPAIR_HASH_PREFIX = "repair";
+
 struct DataItem
 {
 	QString    fileName;
@@ -90,40 +125,87 @@ struct DataItem
 	QDateTime  dateTime;
 };
 
-using DataItems = std::queue<DataItem>;
+using DataItems    = FliLib::WorkQueue<DataItem>;
+using DataItemList = std::vector<DataItem>;
 
-struct ImageStatisticsItem
+struct SpilledImage
 {
-	enum class PixelSchema
-	{
-		Unknown = -1,
-		Normal,
-		GrayScale,
-		Alpha,
-	};
-	QString     folder;
-	QString     fileName;
-	QString     imageId;
-	QString     fail;
-	bool        isCover { false };
-	qsizetype   size { 0 };
-	int         width { 0 };
-	int         height { 0 };
-	PixelSchema schema { PixelSchema::Unknown };
-	QString     hash;
+	bool      isCover { false };
+	QString   filePath;
+	ImageItem imageItem;
+};
+
+using SpilledImages = std::vector<SpilledImage>;
+
+struct ArchiveItems
+{
+	ImageItems      covers;
+	ImageItems      images;
+	SpilledImages   spilled;
+	DataItemList    fb2;
+	ImageStatistics imageStatistics;
+	qsizetype       memory { 0 };
+	qsizetype       spilledSize { 0 };
 };
 
-using ImageStatistics = std::vector<ImageStatisticsItem>;
+class MemoryBudget
+{
+	NON_COPY_MOVABLE(MemoryBudget)
+
+public:
+	explicit MemoryBudget(const qsizetype limit)
+		: m_limit { limit }
+	{
+	}
+
+public:
+	bool IsAvailable(const qsizetype size) const noexcept
+	{
+		return m_limit <= 0 || m_used + size <= m_limit;
+	}
+
+	bool TryAcquire(const qsizetype size) noexcept
+	{
+		auto used = m_used.load();
+		do
+		{
+			if (m_limit > 0 && used + size > m_limit)
+				return false;
+		}
+		while (!m_used.compare_exchange_weak(used, used + size));
+
+		return true;
+	}
+
+	void Acquire(const qsizetype size) noexcept
+	{
+		m_used += size;
+	}
+
+	void Release(const qsizetype size) noexcept
+	{
+		m_used -= size;
+	}
 
-std::expected<QImage, QString> ToImage(QByteArray& body)
+private:
+	const qsizetype        m_limit;
+	std::atomic<qsizetype> m_used { 0 };
+};
+
+std::expected<QImage, QString> ToImage(QByteArray& body, const QSize& maxSize = {}, QSize* originalSize = nullptr)
 {
-	QBuffer buffer(&body);
+	StageTimer timer(Stage::ImageDecode, body.size());
+	QBuffer    buffer(&body);
 	buffer.open(QBuffer::ReadOnly);
 	QImageReader imageReader(&buffer);
+	const auto   size   = FliLib::SetScaledSize(imageReader, maxSize);
 	auto         result = imageReader.read();
 	if (result.isNull()) [[unlikely]]
 		return std::unexpected(imageReader.errorString());
 
+	if (originalSize)
+		*originalSize = size.isValid() ? size : result.size();
+
 	return result;
 }
 
@@ -137,7 +219,10 @@ public:
 	public:
 		virtual ~IClient() = default;
 
-		virtual void OnWorkFinished(ImageStatistics imageStatistics, ImageItems covers, ImageItems images) = 0;
+		virtual void OnWorkFinished(ImageStatistics imageStatistics)                                                                                                     = 0;
+		virtual void AddImage(bool isCover, ImageItem imageItem)                                                                                                         = 0;
+		virtual void Encode(bool isCover, ImageItem imageItem, QImage image, const ImageSettings& settings, EncodeCache::Item cacheItem, bool transcodeJpeg, bool canSkip) = 0;
+		virtual void Write(QString fileName, QByteArray body, QDateTime dateTime)                                                                                        = 0;
 	};
 
 public:
@@ -145,28 +230,28 @@ public:
 		const Settings&          settings,
 		QString                  folder,
 		const IEncodingDetector& encodingDetector,
-		std::condition_variable& queueCondition,
-		std::mutex&              queueGuard,
 		DataItems&               queue,
 		std::mutex&              fileSystemGuard,
 		std::atomic_bool&        hasError,
-		std::atomic_int&         queueSize,
 		Util::Progress&          progress,
 		IClient&                 client,
-		const Decoder&           decoder
+		const Decoder&           decoder,
+		EncodeCache*             encodeCache,
+		ImageRepairer*           imageRepairer,
+		MemoryBudget&            memoryBudget
 	)
 		: m_settings { settings }
 		, m_folder { std::move(folder) }
 		, m_encodingDetector { encodingDetector }
-		, m_queueCondition { queueCondition }
-		, m_queueGuard { queueGuard }
 		, m_queue { queue }
 		, m_fileSystemGuard { fileSystemGuard }
 		, m_hasError { hasError }
-		, m_queueSize { queueSize }
 		, m_progress { progress }
 		, m_client { client }
 		, m_decoder { decoder }
+		, m_encodeCache { encodeCache }
+		, m_imageRepairer { imageRepairer }
+		, m_memoryBudget { memoryBudget }
 		, m_thread { &Worker::Process, this }
 	{
 	}
@@ -178,39 +263,43 @@ public:
 	}
 
 private:
-	void Process()
+	struct ImageError
 	{
-		while (true)
-		{
-			QString    name;
-			QByteArray body;
-			QDateTime  dateTime;
-			{
-				std::unique_lock queueLock(m_queueGuard);
-				m_queueCondition.wait(queueLock, [&]() {
-					return !m_queue.empty();
-				});
-
-				auto [f, d, t] = std::move(m_queue.front());
-				m_queue.pop();
-				--m_queueSize;
-				m_queueCondition.notify_all();
-				name     = std::move(f);
-				body     = std::move(d);
-				dateTime = std::move(t);
-			}
+		QString file;
+		QString errorText;
+		QString ext;
+		bool    needSaveBody { true };
+	};
 
-			if (body.isEmpty())
-				break;
+	struct PendingRepair
+	{
+		bool                     isCover { false };
+		std::optional<ImageItem> imageItem;
+		QByteArray               body;
+		ImageStatisticsItem      statistics;
+		EncodeCache::Item        cacheItem;
+		ImageError               imageError;
+		std::future<QByteArray>  fixed;
+	};
 
+private:
+	void Process()
+	{
+		while (auto item = m_queue.Pop())
+		{
+			const auto& [name, body, dateTime] = *item;
 			if (ProcessFile(name, body, dateTime))
 			{
 				m_hasError = true;
 				PLOGE << "processed with error: " << name;
 			}
+
+			m_memoryBudget.Release(body.size());
+			m_queue.NotifyChanged();
 		}
 
-		m_client.OnWorkFinished(std::move(m_imageStatistics), std::move(m_covers), std::move(m_images));
+		CompleteRepairs();
+		m_client.OnWorkFinished(std::move(m_imageStatistics));
 	}
 
 	bool ProcessFile(const QString& inputFilePath, const QByteArray& inputFileBody, const QDateTime& dateTime)
@@ -251,26 +340,10 @@ private:
 		if (body.isEmpty())
 			return WriteError(inputFilePath, inputFileBody, "no output found", true, fileInfo.suffix()), false;
 
-		if (!m_settings.saveFb2)
-			return false;
-
-		std::scoped_lock fileSystemLock(m_fileSystemGuard);
-		const auto       outputFilePath = m_settings.dstDir.filePath(name);
-		const QFileInfo  outputFileInfo(outputFilePath);
-		if (auto dir = outputFileInfo.dir(); !dir.exists())
-			dir.mkpath(".");
+		if (m_settings.saveFb2)
+			m_client.Write(std::move(name), std::move(body), dateTime);
 
-		QFile bodyFile(outputFilePath);
-		if (!bodyFile.open(QIODevice::WriteOnly))
-		{
-			PLOGW << QString("Cannot write body to %1").arg(outputFilePath);
-			return true;
-		}
-
-		if (bodyFile.write(body) != body.size())
-			return true;
-
-		return !bodyFile.setFileTime(dateTime, QFile::FileTime::FileBirthTime);
+		return false;
 	}
 
 	IParser::OutputFile ParseFile(IParser& parser, const QDateTime& dateTime)
@@ -280,34 +353,41 @@ private:
 
 		static constexpr const char* passThruBinTypes[] = { "zip", "rar", "txt", "pdf" };
 
-		const auto encode = [this](const ImageSettings& settings, const QString& fileName, const QImage& image, const QByteArray& body) -> QByteArray {
-			if (fileName.isEmpty())
-				return {};
-
-			if (auto bytes = JXL::Encode(image, settings.quality); !bytes.isEmpty())
-				return bytes;
-
-			(void)AddError(settings, fileName, body, QString("Cannot compress %1 %2").arg(settings.type).arg(fileName), true, {}, false);
-			return {};
-		};
-
 		std::unordered_map<QString, int> uniqueData;
 		IParser::ImageMapper             idToNum;
 
 		auto binaryCallback = [&](QString&& name, const bool isCover, QByteArray body) {
-			ImageStatisticsItem::PixelSchema pixelSchema = ImageStatisticsItem::PixelSchema::Unknown;
+			ImageStatisticsItem statistics { .folder = m_folder, .fileName = completeFileName, .imageId = name, .isCover = isCover };
+
+			const char* fail    = nullptr;
+			bool        pending = false;
+
+			QString    bodyHash;
+			const auto getBodyHash = [&]() -> const QString& {
+				if (bodyHash.isEmpty())
+				{
+					m_hash.Reset();
+					m_hash.AddData(body);
+					bodyHash = QString::fromUtf8(m_hash.Result().toHex());
+				}
+				return bodyHash;
+			};
 
-			int         width  = 0;
-			int         height = 0;
-			const char* fail   = nullptr;
+			const auto fillStatistics = [&] {
+				if (!m_settings.NeedImageStatistics())
+					return;
+
+				statistics.fail = fail;
+				statistics.size = body.size();
+				statistics.hash = getBodyHash();
+			};
 
-			ScopedCall statGuard([&, name]() mutable {
-				if (m_settings.imageStatistics.isEmpty())
+			ScopedCall statGuard([&] {
+				if (pending || !m_settings.NeedImageStatistics())
 					return;
 
-				m_hash.reset();
-				m_hash.addData(body);
-				m_imageStatistics.emplace_back(m_folder, completeFileName, std::move(name), fail, isCover, body.size(), width, height, pixelSchema, QString::fromUtf8(m_hash.result().toHex()));
+				fillStatistics();
+				m_imageStatistics.push_back(std::move(statistics));
 			});
 
 			const QFileInfo imageFileInfo(name);
@@ -321,71 +401,63 @@ private:
 			{
 				fail           = *it;
 				auto imageFile = m_settings.image.fileNameGetter(completeFileName, name);
-				m_hash.reset();
-				m_hash.addData(body);
 
-				ImageItem imageItem { .fileName = std::move(imageFile), .body = body, .dateTime = dateTime, .hash = QString::fromUtf8(m_hash.result().toHex()) };
+				ImageItem imageItem { .fileName = std::move(imageFile), .body = body, .dateTime = dateTime, .hash = getBodyHash() };
 
 				if (!m_settings.image.save)
 					imageItem.body = {};
 
-				(isCover ? m_covers : m_images).emplace_back(std::move(imageItem));
+				m_client.AddImage(isCover, std::move(imageItem));
 				return;
 			}
 
 			const auto& settings = isCover ? m_settings.cover : m_settings.image;
 
-			auto image = ReadImage(body, settings, settings.fileNameGetter(completeFileName, name), fail, settings.save);
-			if (image.isNull())
-				return;
-
-			width  = image.width();
-			height = image.height();
-
-			if (image.pixelFormat().colorModel() == QPixelFormat::Grayscale)
-				pixelSchema = ImageStatisticsItem::PixelSchema::GrayScale;
-
-			if (settings.grayscale)
-				image.convertTo(QImage::Format::Format_Grayscale8);
-
-			if (image.pixelFormat().colorModel() != QPixelFormat::Grayscale)
-				image = Util::HasAlpha(image, body.constData());
-
-			const auto pixelFormat = image.pixelFormat();
-			const bool hasAlpha    = pixelFormat.alphaUsage() == QPixelFormat::UsesAlpha;
-			if (pixelSchema == ImageStatisticsItem::PixelSchema::Unknown)
-				pixelSchema = hasAlpha ? ImageStatisticsItem::PixelSchema::Alpha : ImageStatisticsItem::PixelSchema::Normal;
-
-			if (image.width() > settings.maxSize.width() || image.height() > settings.maxSize.height())
-				image = image.scaled(settings.maxSize.width(), settings.maxSize.height(), Qt::KeepAspectRatio, hasAlpha ? Qt::FastTransformation : Qt::SmoothTransformation);
-
-			m_hash.reset();
-			for (auto h = 0, szH = image.height(), szW = image.width(); h < szH; ++h)
-				m_hash.addData(QByteArrayView { std::bit_cast<const char*>(image.constScanLine(h)), static_cast<qsizetype>(szW) * pixelFormat.channelCount() });
-			auto hash = QString::fromUtf8(m_hash.result().toHex());
+			EncodeCache::Item cacheItem;
+			if (m_encodeCache && settings.save)
+			{
+				cacheItem.key = EncodeCache::GetKey(getBodyHash(), settings, m_settings.cover.quality, m_hash.GetAlgorithm(), m_settings.jpegTranscode);
+				if (auto cached = m_encodeCache->Get(cacheItem.key))
+				{
+					statistics.width  = cached->width;
+					statistics.height = cached->height;
+					statistics.schema = static_cast<ImageStatisticsItem::PixelSchema>(cached->pixelSchema);
+					if (auto imageItem = AddUniqueImage(uniqueData, idToNum, std::move(name), std::move(cached->hash), isCover, settings, completeFileName, dateTime))
+					{
+						imageItem->body = std::move(cached->body);
+						m_client.AddImage(isCover, std::move(*imageItem));
+					}
+					return;
+				}
+			}
 
-			if (const auto it = uniqueData.find(hash); it != uniqueData.end())
+			QSize                     originalSize;
+			std::optional<ImageError> imageError;
+			auto                      image = ReadImage(body, settings, settings.fileNameGetter(completeFileName, name), fail, settings.save, originalSize, imageError);
+			if (imageError)
 			{
-				if (isCover)
-					it->second = -1;
+				pending = true;
+				fillStatistics();
+				auto fixed = m_imageRepairer->Repair(imageError->file, settings.maxSize, body);
 
-				idToNum.try_emplace(std::move(name), it->second);
+				// the book is written before ffmpeg finishes, so a repaired image takes its own number now and is never merged with an identical one
+				auto imageItem = AddUniqueImage(uniqueData, idToNum, name, QString("%1/%2").arg(REPAIR_HASH_PREFIX, name), isCover, settings, completeFileName, dateTime);
+				m_pendingRepairs.emplace_back(isCover, std::move(imageItem), std::move(body), std::move(statistics), std::move(cacheItem), std::move(*imageError), std::move(fixed));
 				return;
 			}
 
-			const auto [it, added] = uniqueData.try_emplace(std::move(hash), isCover ? -1 : static_cast<int>(uniqueData.size()));
+			if (image.isNull())
+				return;
 
-			const auto num       = it->second;
-			auto       imageFile = settings.fileNameGetter(completeFileName, isCover ? name : QString::number(num));
-			idToNum.try_emplace(std::move(name), num);
+			statistics.width  = originalSize.isValid() ? originalSize.width() : image.width();
+			statistics.height = originalSize.isValid() ? originalSize.height() : image.height();
 
-			if (!settings.save)
+			auto hash      = PrepareImage(settings, body, image, statistics);
+			auto imageItem = AddUniqueImage(uniqueData, idToNum, std::move(name), std::move(hash), isCover, settings, completeFileName, dateTime);
+			if (!imageItem)
 				return;
 
-			ImageItem imageItem { .fileName = std::move(imageFile), .body = body, .dateTime = dateTime, .hash = it->first };
-			if (auto encoded = encode(m_settings.cover, imageItem.fileName, image, imageItem.body); encoded.size() < imageItem.body.size())
-				imageItem.body = std::move(encoded);
-			(isCover ? m_covers : m_images).emplace_back(std::move(imageItem));
+			EncodeImage(isCover, std::move(*imageItem), body, std::move(image), statistics, std::move(cacheItem), true);
 		};
 
 		QString errorText;
@@ -406,7 +478,123 @@ private:
 		return {};
 	}
 
-	QImage ReadImage(QByteArray& body, const ImageSettings& settings, const QString& imageFile, const char*& fail, const bool needSaveBody) const
+	QString PrepareImage(const ImageSettings& settings, const QByteArray& body, QImage& image, ImageStatisticsItem& statistics)
+	{
+		if (image.pixelFormat().colorModel() == QPixelFormat::Grayscale)
+			statistics.schema = ImageStatisticsItem::PixelSchema::GrayScale;
+
+		if (settings.grayscale)
+			image = FliLib::ToGrayscale(std::move(image));
+
+		if (image.pixelFormat().colorModel() != QPixelFormat::Grayscale)
+			if (image = FliLib::DropOpaqueAlpha(std::move(image)); image.hasAlphaChannel())
+				image = Util::HasAlpha(image, body.constData());
+
+		const auto pixelFormat = image.pixelFormat();
+		const bool hasAlpha    = pixelFormat.alphaUsage() == QPixelFormat::UsesAlpha;
+		if (statistics.schema == ImageStatisticsItem::PixelSchema::Unknown)
+			statistics.schema = hasAlpha ? ImageStatisticsItem::PixelSchema::Alpha : ImageStatisticsItem::PixelSchema::Normal;
+
+		if (image.width() > settings.maxSize.width() || image.height() > settings.maxSize.height())
+		{
+			StageTimer timer(Stage::Scale, image.sizeInBytes());
+			image = image.scaled(settings.maxSize.width(), settings.maxSize.height(), Qt::KeepAspectRatio, hasAlpha ? Qt::FastTransformation : Qt::SmoothTransformation);
+			timer.SetBytesOut(image.sizeInBytes());
+		}
+
+		m_hash.Reset();
+		FliLib::AddPixelData(m_hash, image, pixelFormat.channelCount());
+		return QString::fromUtf8(m_hash.Result().toHex());
+	}
+
+	void EncodeImage(const bool isCover, ImageItem imageItem, const QByteArray& body, QImage image, const ImageStatisticsItem& statistics, EncodeCache::Item cacheItem, const bool isOriginalBody)
+	{
+		const auto& settings = isCover ? m_settings.cover : m_settings.image;
+
+		const auto canSkip       = isOriginalBody && !settings.grayscale && image.width() == statistics.width && image.height() == statistics.height;
+		const auto transcodeJpeg = m_settings.jpegTranscode && canSkip && FliLib::IsJpeg(body);
+
+		imageItem.body = body;
+		if (!cacheItem.key.isEmpty())
+		{
+			cacheItem.hash        = imageItem.hash;
+			cacheItem.width       = statistics.width;
+			cacheItem.height      = statistics.height;
+			cacheItem.pixelSchema = static_cast<int>(statistics.schema);
+		}
+
+		m_client.Encode(isCover, std::move(imageItem), std::move(image), m_settings.cover, std::move(cacheItem), transcodeJpeg, canSkip);
+	}
+
+	void CompleteRepairs()
+	{
+		for (auto& [isCover, imageItem, body, statistics, cacheItem, imageError, fixed] : m_pendingRepairs)
+		{
+			QImage image;
+			if (auto fixedBody = fixed.get(); !fixedBody.isEmpty())
+			{
+				if (auto decoded = ToImage(fixedBody))
+					image = std::move(*decoded);
+				else
+					PLOGW << decoded.error();
+			}
+
+			if (image.isNull())
+			{
+				WriteError(imageError.file, body, imageError.errorText, imageError.needSaveBody, imageError.ext);
+			}
+			else
+			{
+				statistics.width  = image.width();
+				statistics.height = image.height();
+
+				auto hash = PrepareImage(isCover ? m_settings.cover : m_settings.image, body, image, statistics);
+				if (imageItem)
+				{
+					imageItem->hash = std::move(hash);
+					EncodeImage(isCover, std::move(*imageItem), body, std::move(image), statistics, std::move(cacheItem), false);
+				}
+			}
+
+			if (m_settings.NeedImageStatistics())
+				m_imageStatistics.push_back(std::move(statistics));
+		}
+		m_pendingRepairs.clear();
+	}
+
+	static std::optional<ImageItem> AddUniqueImage(
+		std::unordered_map<QString, int>& uniqueData,
+		IParser::ImageMapper&             idToNum,
+		QString                           name,
+		QString                           hash,
+		const bool                        isCover,
+		const ImageSettings&              settings,
+		const QString&                    completeFileName,
+		const QDateTime&                  dateTime
+	)
+	{
+		if (const auto it = uniqueData.find(hash); it != uniqueData.end())
+		{
+			if (isCover)
+				it->second = -1;
+
+			idToNum.try_emplace(std::move(name), it->second);
+			return std::nullopt;
+		}
+
+		const auto [it, added] = uniqueData.try_emplace(std::move(hash), isCover ? -1 : static_cast<int>(uniqueData.size()));
+
+		const auto num       = it->second;
+		auto       imageFile = settings.fileNameGetter(completeFileName, isCover ? name : QString::number(num));
+		idToNum.try_emplace(std::move(name), num);
+
+		if (!settings.save)
+			return std::nullopt;
+
+		return ImageItem { .fileName = std::move(imageFile), .dateTime = dateTime, .hash = it->first };
+	}
+
+	QImage ReadImage(QByteArray& body, const ImageSettings& settings, const QString& imageFile, const char*& fail, const bool needSaveBody, QSize& originalSize, std::optional<ImageError>& imageError) const
 	{
 		struct Signature
 		{
@@ -442,10 +630,10 @@ private:
 		    it != std::end(base64Signatures))
 		{
 			body = QByteArray::fromBase64(body);
-			return ReadImage(body, settings, imageFile, fail, needSaveBody);
+			return ReadImage(body, settings, imageFile, fail, needSaveBody, originalSize, imageError);
 		}
 
-		auto image = ToImage(body);
+		auto image = ToImage(body, settings.maxSize, &originalSize);
 		if (image)
 		{
 			auto result = std::move(image.value());
@@ -466,7 +654,7 @@ private:
 			);
 		    it != std::end(signatures))
 			return (fail = it->extension),
-			       AddError(settings, imageFile, body, QString("%1 %2 may be damaged: %3").arg(settings.type).arg(imageFile).arg(image.error()), needSaveBody && it->needSaveBody, it->extension);
+			       AddError(imageFile, body, imageError, QString("%1 %2 may be damaged: %3").arg(settings.type).arg(imageFile).arg(image.error()), needSaveBody && it->needSaveBody, it->extension);
 
 		if (const auto it = std::ranges::find_if(
 				unsupportedSignatures,
@@ -476,7 +664,7 @@ private:
 			);
 		    it != std::end(unsupportedSignatures))
 			return (fail = it->extension),
-			       AddError(settings, imageFile, body, QString("possibly an %1 %2 in %3 format").arg(settings.type).arg(imageFile).arg(it->extension), needSaveBody && it->needSaveBody, it->extension);
+			       AddError(imageFile, body, imageError, QString("possibly an %1 %2 in %3 format").arg(settings.type).arg(imageFile).arg(it->extension), needSaveBody && it->needSaveBody, it->extension);
 
 		if (const auto it = std::ranges::find_if(
 				knownSignatures,
@@ -486,19 +674,18 @@ private:
 			);
 		    it != std::end(knownSignatures))
 			return (fail = it->extension),
-			       AddError(settings, imageFile, body, QString("%1 %2 is %3").arg(settings.type).arg(imageFile).arg(it->extension), needSaveBody && it->needSaveBody, it->extension, false);
+			       AddError(imageFile, body, imageError, QString("%1 %2 is %3").arg(settings.type).arg(imageFile).arg(it->extension), needSaveBody && it->needSaveBody, it->extension, false);
 
 		if (QString::fromUtf8(body).contains("!doctype html", Qt::CaseInsensitive))
-			return fail = knownSignatures[0].extension, AddError(settings, imageFile, body, QString("possibly an %1 %2 in %3 format").arg(settings.type).arg(imageFile).arg("html"), false, "html", false);
+			return fail = knownSignatures[0].extension, AddError(imageFile, body, imageError, QString("possibly an %1 %2 in %3 format").arg(settings.type).arg(imageFile).arg("html"), false, "html", false);
 
-		return AddError(settings, imageFile, body, QString("%1 %2 may be damaged: %3").arg(settings.type).arg(imageFile).arg(image.error()), needSaveBody);
+		return AddError(imageFile, body, imageError, QString("%1 %2 may be damaged: %3").arg(settings.type).arg(imageFile).arg(image.error()), needSaveBody);
 	}
 
-	QImage AddError(const ImageSettings& settings, const QString& file, const QByteArray& body, const QString& errorText, const bool needSaveBody, const QString& ext = {}, const bool tryToFix = true) const
+	QImage AddError(const QString& file, const QByteArray& body, std::optional<ImageError>& imageError, const QString& errorText, const bool needSaveBody, const QString& ext = {}, const bool tryToFix = true) const
 	{
-		if (tryToFix)
-			if (auto fixed = TryToFix(settings, file, body); !fixed.isNull())
-				return fixed;
+		if (tryToFix && m_imageRepairer && body.size() >= 128)
+			return imageError = ImageError { .file = file, .errorText = errorText, .ext = ext, .needSaveBody = needSaveBody }, QImage {};
 
 		WriteError(file, body, errorText, needSaveBody, ext);
 		return {};
@@ -514,79 +701,28 @@ private:
 		}
 	}
 
-	QImage TryToFix(const ImageSettings& settings, const QString& imageFile, const QByteArray& body) const
-	{
-		if (m_settings.ffmpeg.isEmpty() || body.size() < 128)
-			return {};
-
-		QProcess   process;
-		QEventLoop eventLoop;
-		const auto args           = QStringList() << "-i" << "pipe:0" << "-f" << "mjpeg" << "-vf"
-		                                          << QString("scale='min(%1,iw)':min'(%2,ih)':force_original_aspect_ratio=decrease").arg(settings.maxSize.width()).arg(settings.maxSize.height()) << "pipe:1";
-		const auto ffmpegFileName = QFileInfo(m_settings.ffmpeg).fileName();
-
-		QByteArray fixed;
-		QObject::connect(&process, &QProcess::started, [&] {
-			PLOGI << QString("ffmpeg launched for %1 %2\n%3 %4").arg(settings.type, imageFile, ffmpegFileName, args.join(" "));
-		});
-		QObject::connect(&process, &QProcess::finished, [&](const int code, const QProcess::ExitStatus) {
-			if (code == 0)
-				PLOGI << QString("%1 %2 is probably fixed").arg(settings.type, imageFile);
-			else
-				PLOGW << QString("Cannot fix %1 %2, ffmpeg finished with %3").arg(settings.type, imageFile).arg(code);
-			eventLoop.exit(code);
-		});
-		QObject::connect(&process, &QProcess::readyReadStandardError, [&] {
-			PLOGW << "\n" << process.readAllStandardError();
-		});
-		QObject::connect(&process, &QProcess::readyReadStandardOutput, [&] {
-			fixed.append(process.readAllStandardOutput());
-		});
-
-		process.start(m_settings.ffmpeg, args, QIODevice::ReadWrite);
-		process.write(body);
-		process.closeWriteChannel();
-
-		eventLoop.exec();
-
-		if (fixed.isEmpty())
-			return {};
-
-		auto image = ToImage(fixed);
-		if (image)
-		{
-			auto result = std::move(image.value());
-			return result;
-		}
-
-		PLOGW << image.error();
-		return {};
-	}
-
 private:
 	const Settings&          m_settings;
 	const QString            m_folder;
 	const IEncodingDetector& m_encodingDetector;
 
-	std::condition_variable& m_queueCondition;
-	std::mutex&              m_queueGuard;
-	DataItems&               m_queue;
-	std::mutex&              m_fileSystemGuard;
+	DataItems&  m_queue;
+	std::mutex& m_fileSystemGuard;
 
 	std::atomic_bool& m_hasError;
-	std::atomic_int&  m_queueSize;
 	Util::Progress&   m_progress;
 
-	QCryptographicHash m_hash { QCryptographicHash::Md5 };
-	ImageStatistics    m_imageStatistics;
-
-	ImageItems m_images;
-	ImageItems m_covers;
+	FliLib::Hash               m_hash { m_settings.hashAlgorithm };
+	ImageStatistics            m_imageStatistics;
+	std::vector<PendingRepair> m_pendingRepairs;
 
 	const Util::XmlValidator m_validator;
 
 	IClient&       m_client;
 	const Decoder& m_decoder;
+	EncodeCache*   m_encodeCache;
+	ImageRepairer* m_imageRepairer;
+	MemoryBudget&  m_memoryBudget;
 
 	std::thread m_thread;
 };
@@ -597,6 +733,32 @@ QString GetImagesFolder(const QDir& dir, const QString& type)
 	return QString("%1/%2/%3.zip").arg(fileInfo.dir().path(), type, fileInfo.fileName());
 }
 
+QString GetSpillFolder(const QDir& dir)
+{
+	const QFileInfo fileInfo(dir.path());
+	return QString("%1/%2/%3").arg(fileInfo.dir().path(), SPILL_FOLDER, fileInfo.fileName());
+}
+
+bool WriteOutputFile(const QDir& dir, const QString& fileName, const QByteArray& body, const QDateTime& dateTime)
+{
+	const auto      outputFilePath = dir.filePath(fileName);
+	const QFileInfo outputFileInfo(outputFilePath);
+	if (auto outputDir = outputFileInfo.dir(); !outputDir.exists())
+		outputDir.mkpath(".");
+
+	QFile bodyFile(outputFilePath);
+	if (!bodyFile.open(QIODevice::WriteOnly))
+	{
+		PLOGW << QString("Cannot write body to %1").arg(outputFilePath);
+		return true;
+	}
+
+	if (bodyFile.write(body) != body.size())
+		return true;
+
+	return !bodyFile.setFileTime(dateTime, QFile::FileTime::FileBirthTime);
+}
+
 class FileProcessor final : public Worker::IClient
 {
 public:
@@ -604,37 +766,44 @@ public:
 		const Settings&          settings,
 		const QString&           folder,
 		const IEncodingDetector& encodingDetector,
-		std::condition_variable& queueCondition,
-		std::mutex&              queueGuard,
 		const int                poolSize,
 		Util::Progress&          progress,
-		QTextStream*             imageStatisticsStream,
-		const Decoder&           decoder
+		const Decoder&           decoder,
+		EncodeCache*             encodeCache,
+		EncodePredictor*         encodePredictor,
+		ImageRepairer*           imageRepairer,
+		MemoryBudget&            memoryBudget
 	)
-		: m_queueCondition { queueCondition }
-		, m_queueGuard { queueGuard }
+		: m_queue { static_cast<size_t>(poolSize) * 2 }
 		, m_dstDir { settings.dstDir }
-		, m_saveCovers { settings.cover.save }
-		, m_saveImages { settings.image.save }
-		, m_maxThreadCount { settings.maxThreadCount }
-		, m_imageStatisticsStream { imageStatisticsStream }
+		, m_fb2MemoryLimit { settings.archiveFb2 && settings.archiver.isEmpty() ? static_cast<qsizetype>(settings.fb2MemoryLimit) * 1024 * 1024 : 0 }
+		, m_encodeCache { encodeCache }
+		, m_encodePredictor { encodePredictor }
+		, m_memoryBudget { memoryBudget }
+		, m_spillDir { GetSpillFolder(settings.dstDir) }
+		, m_encoderPool { { .threadCount = static_cast<unsigned>(settings.encoderThreadCount), .maxQueueSize = static_cast<size_t>(settings.encoderThreadCount) * 2 } }
+		, m_writerPool { { .threadCount = 1U, .maxQueueSize = static_cast<size_t>(poolSize) * 2 } }
 	{
 		for (int i = 0; i < poolSize; ++i)
-			m_workers.push_back(std::make_unique<Worker>(settings, folder, encodingDetector, m_queueCondition, m_queueGuard, m_queue, m_fileSystemGuard, m_hasError, m_queueSize, progress, *this, decoder));
+			m_workers.push_back(std::make_unique<Worker>(settings, folder, encodingDetector, m_queue, m_fileSystemGuard, m_hasError, progress, *this, decoder, encodeCache, imageRepairer, memoryBudget));
 	}
 
 public:
-	int GetQueueSize() const
+	size_t GetQueueSize() const
 	{
-		return m_queueSize;
+		return m_queue.GetSize();
+	}
+
+	template <typename Predicate>
+	void WaitForQueue(Predicate predicate)
+	{
+		m_queue.WaitUntil(std::move(predicate));
 	}
 
 	void Enqueue(QString file, QByteArray data, QDateTime dateTime)
 	{
-		std::unique_lock lock(m_queueGuard);
-		m_queue.emplace(std::move(file), std::move(data), std::move(dateTime));
-		++m_queueSize;
-		m_queueCondition.notify_all();
+		m_memoryBudget.Acquire(data.size());
+		m_queue.Push({ std::move(file), std::move(data), std::move(dateTime) });
 	}
 
 	bool HasError() const
@@ -642,111 +811,422 @@ public:
 		return m_hasError;
 	}
 
-	void Wait()
+	ArchiveItems Wait()
 	{
+		m_queue.Close();
 		m_workers.clear();
-		WriteImageStatistics();
-		ArchiveImages(m_covers, m_images);
+		m_encoderPool.wait();
+		m_writerPool.wait();
+		if (!m_spilled.empty())
+			PLOGI << QString("%1 images spilled to %2").arg(m_spilled.size()).arg(m_spillDir.path());
+
+		return { std::move(m_covers), std::move(m_images), std::move(m_spilled), std::move(m_fb2), std::move(m_imageStatistics), m_memory, m_spilledSize };
 	}
 
-	void ArchiveImages(ImageItems& covers, ImageItems& images) const
+private:
+	bool SpillImage(const bool isCover, ImageItem& imageItem)
 	{
-		ArchiveImages(m_saveImages, Global::IMAGES, images);
-		ArchiveImages(m_saveCovers, Global::COVERS, covers);
+		std::scoped_lock fileSystemLock(m_fileSystemGuard);
+		if (!m_spillDir.exists() && !m_spillDir.mkpath("."))
+			return false;
+
+		auto  filePath = m_spillDir.filePath(QString::number(m_spilled.size()));
+		QFile file(filePath);
+		if (!file.open(QIODevice::WriteOnly) || file.write(imageItem.body) != imageItem.body.size())
+			return false;
+
+		const auto size = imageItem.body.size();
+		imageItem.body.clear();
+		std::lock_guard lock(m_workClientGuard);
+		m_spilled.emplace_back(isCover, std::move(filePath), std::move(imageItem));
+		m_spilledSize += size;
+		return true;
+	}
+
+	bool WriteFile(const QString& fileName, const QByteArray& body, const QDateTime& dateTime)
+	{
+		std::scoped_lock fileSystemLock(m_fileSystemGuard);
+		return WriteOutputFile(m_dstDir, fileName, body, dateTime);
+	}
+
+private: // Worker::IClient
+	void OnWorkFinished(ImageStatistics imageStatistics) override
+	{
+		std::lock_guard lock(m_workClientGuard);
+		m_imageStatistics.reserve(m_imageStatistics.size() + imageStatistics.size());
+		std::ranges::move(std::move(imageStatistics), std::back_inserter(m_imageStatistics));
+	}
+
+	void AddImage(const bool isCover, ImageItem imageItem) override
+	{
+		const auto size = imageItem.body.size();
+		if (!m_memoryBudget.TryAcquire(size))
+		{
+			if (SpillImage(isCover, imageItem))
+				return;
+
+			m_memoryBudget.Acquire(size);
+		}
+
+		std::lock_guard lock(m_workClientGuard);
+		m_memory += size;
+		(isCover ? m_covers : m_images).emplace_back(std::move(imageItem));
+	}
+
+	void Encode(const bool isCover, ImageItem imageItem, QImage image, const ImageSettings& settings, EncodeCache::Item cacheItem, const bool transcodeJpeg, const bool canSkip) override
+	{
+		m_encoderPool.enqueue([this, isCover, imageItem = std::move(imageItem), image = std::move(image), &settings, cacheItem = std::move(cacheItem), transcodeJpeg, canSkip](auto) mutable {
+			std::optional<EncodePredictor::Prediction> prediction;
+			if (m_encodePredictor && canSkip && !transcodeJpeg)
+			{
+				if (prediction = m_encodePredictor->Predict(imageItem.body, image, settings.quality); !prediction->encode)
+				{
+					AddImage(isCover, std::move(imageItem));
+					return;
+				}
+			}
+
+			QByteArray encoded;
+			if (transcodeJpeg)
+			{
+				StageTimer timer(Stage::Transcode, imageItem.body.size());
+				encoded = FliLib::TranscodeJpeg(imageItem.body);
+				timer.SetBytesOut(encoded.size());
+				if (encoded.isEmpty())
+					PLOGW << imageItem.fileName << ": jpeg transcoding failed, encoding pixels";
+			}
+
+			if (encoded.isEmpty())
+			{
+				StageTimer timer(Stage::Encode, image.sizeInBytes());
+				encoded = JXL::Encode(image, settings.quality);
+				timer.SetBytesOut(encoded.size());
+			}
+
+			if (encoded.isEmpty())
+			{
+				PLOGW << imageItem.fileName << ": " << QString("Cannot compress %1 %2").arg(settings.type).arg(imageItem.fileName);
+				WriteErrorFile(m_dstDir, m_fileSystemGuard, imageItem.fileName, {}, imageItem.body);
+				m_hasError = true;
+			}
+			else
+			{
+				if (prediction)
+					m_encodePredictor->Update(*prediction, encoded.size() < imageItem.body.size());
+
+				if (encoded.size() < imageItem.body.size())
+					imageItem.body = std::move(encoded);
+
+				if (m_encodeCache && !cacheItem.key.isEmpty())
+				{
+					cacheItem.body = imageItem.body;
+					m_encodeCache->Put(cacheItem);
+				}
+			}
+
+			AddImage(isCover, std::move(imageItem));
+		});
+	}
+
+	void Write(QString fileName, QByteArray body, QDateTime dateTime) override
+	{
+		m_writerPool.enqueue([this, fileName = std::move(fileName), body = std::move(body), dateTime = std::move(dateTime)](auto) mutable {
+			if (m_fb2MemoryLimit > 0)
+			{
+				if (m_fb2Memory + body.size() <= m_fb2MemoryLimit && m_memoryBudget.TryAcquire(body.size()))
+				{
+					m_fb2Memory += body.size();
+					m_fb2.emplace_back(std::move(fileName), std::move(body), std::move(dateTime));
+					std::lock_guard lock(m_workClientGuard);
+					m_memory += m_fb2.back().body.size();
+					return;
+				}
+
+				if (!m_fb2Spilled)
+				{
+					m_fb2Spilled = true;
+					PLOGI << QString("fb2 memory limit exceeded, writing the rest to %1").arg(m_dstDir.path());
+				}
+			}
+
+			if (!WriteFile(fileName, body, dateTime))
+				return;
+
+			m_hasError = true;
+			PLOGE << "processed with error: " << fileName;
+		});
 	}
 
 private:
-	void ArchiveImages(const bool saveFlag, const char* type, ImageItems& images) const //-V826
+	std::atomic_bool m_hasError { false };
+	DataItems        m_queue;
+	std::mutex       m_fileSystemGuard;
+
+	std::mutex m_workClientGuard;
+
+	QDir            m_dstDir;
+	const qsizetype m_fb2MemoryLimit;
+	qsizetype       m_fb2Memory { 0 };
+	bool            m_fb2Spilled { false };
+	DataItemList    m_fb2;
+
+	ImageStatistics  m_imageStatistics;
+	ImageItems       m_covers;
+	ImageItems       m_images;
+	SpilledImages    m_spilled;
+	qsizetype        m_memory { 0 };
+	qsizetype        m_spilledSize { 0 };
+	EncodeCache*     m_encodeCache;
+	EncodePredictor* m_encodePredictor;
+	MemoryBudget&    m_memoryBudget;
+	QDir             m_spillDir;
+
+	Util::ThreadPool<> m_encoderPool;
+	Util::ThreadPool<> m_writerPool;
+
+	std::vector<std::unique_ptr<Worker>> m_workers;
+};
+
+bool ArchiveImages(const Settings& settings, const bool saveFlag, const char* type, ImageItems& images) //-V826
+{
+	if (!saveFlag || images.empty())
+		return false;
+
+	const auto archiveFileName = GetImagesFolder(settings.dstDir, type);
+	PLOGI << "archive " << archiveFileName << ", total:" << images.size();
+
+	QFile::remove(archiveFileName);
+
+	std::unordered_map<QString, qsizetype> unique;
+	for (const auto& image : images)
 	{
-		if (!saveFlag || images.empty())
-			return;
+		auto& item = unique[image.fileName];
+		item       = std::max(item, image.body.size());
+	}
+
+	std::erase_if(images, [&](const auto& image) {
+		const auto it = unique.find(image.fileName);
+		assert(it != unique.end());
+		return image.body.size() < it->second;
+	});
+
+	const auto proj = [](const auto& item) {
+		return item.fileName;
+	};
+	std::ranges::sort(images, {}, proj);
+	if (const auto range = std::ranges::unique(images, {}, proj); !range.empty())
+		images.erase(range.begin(), range.end()); //-V539
+
+	StageTimer timer(Stage::ArchiveImages, std::accumulate(images.begin(), images.end(), qint64 { 0 }, [](const qint64 init, const ImageItem& image) {
+		return init + image.body.size();
+	}));
+
+	FliLib::ArchiveWriter writer(archiveFileName, Zip::Format::Zip, true);
+	writer.SetProperty(Zip::PropertyId::ThreadsCount, settings.maxThreadCount);
+	for (auto&& image : images)
+		writer.Append(std::move(image.fileName), std::move(image.body), std::move(image.dateTime));
+	images.clear();
+
+	const auto isIncompressible = writer.IsIncompressible();
+	writer.SetProperty(Zip::PropertyId::CompressionLevel, QVariant::fromValue(isIncompressible ? Zip::CompressionLevel::None : Zip::CompressionLevel::Ultra));
+
+	const auto startTime = std::chrono::steady_clock::now();
+	if (!writer.Finalize())
+	{
+		PLOGE << "Cannot write " << archiveFileName;
+		return true;
+	}
 
-		const auto archiveFileName = GetImagesFolder(m_dstDir, type);
-		PLOGI << "archive " << archiveFileName << ", total:" << images.size();
+	const auto archiveSize = QFileInfo(archiveFileName).size();
+	timer.SetBytesOut(archiveSize);
 
-		QFile::remove(archiveFileName);
+	PLOGI << QString("%1 %2: %3 of %4 bytes incompressible, %5 bytes written in %6 ms")
+				 .arg(isIncompressible ? "stored" : "compressed", archiveFileName)
+				 .arg(writer.GetIncompressibleSize())
+				 .arg(writer.GetSize())
+				 .arg(archiveSize)
+				 .arg(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count());
 
-		std::unordered_map<QString, qsizetype> unique;
-		for (const auto& image : images)
+	return false;
+}
+
+qsizetype LoadSpilledImages(SpilledImages& spilled, const bool isCover, ImageItems& images, MemoryBudget& memoryBudget)
+{
+	qsizetype result = 0;
+	for (auto& item : spilled)
+	{
+		if (item.isCover != isCover)
+			continue;
+
+		QFile file(item.filePath);
+		if (!file.open(QIODevice::ReadOnly))
 		{
-			auto& item = unique[image.fileName];
-			item       = std::max(item, image.body.size());
+			PLOGE << "cannot read " << item.filePath;
+			continue;
 		}
 
-		std::erase_if(images, [&](const auto& image) {
-			const auto it = unique.find(image.fileName);
-			assert(it != unique.end());
-			return image.body.size() < it->second;
-		});
+		memoryBudget.Acquire(file.size());
+		result              += file.size();
+		item.imageItem.body  = file.readAll();
+		images.emplace_back(std::move(item.imageItem));
+	}
 
-		const auto proj = [](const auto& item) {
-			return item.fileName;
-		};
-		std::ranges::sort(images, {}, proj);
-		if (const auto range = std::ranges::unique(images, {}, proj); !range.empty())
-			images.erase(range.begin(), range.end()); //-V539
+	return result;
+}
 
-		auto zipFiles = Zip::CreateZipFileController();
-		for (auto&& image : images)
-			zipFiles->AddFile(std::move(image.fileName), image.body, std::move(image.dateTime));
+bool ArchiveImages(const Settings& settings, ArchiveItems& archiveItems, MemoryBudget& memoryBudget)
+{
+	bool hasError = false;
+
+	const auto archiveImages = [&](const bool isCover, const ImageSettings& imageSettings, const char* type) {
+		auto& images = isCover ? archiveItems.covers : archiveItems.images;
+		auto  size   = std::accumulate(images.begin(), images.end(), qsizetype { 0 }, [](const qsizetype init, const ImageItem& image) {
+			return init + image.body.size();
+		});
 
-		Zip zip(archiveFileName, Zip::Format::Zip);
-		zip.SetProperty(Zip::PropertyId::CompressionLevel, QVariant::fromValue(Zip::CompressionLevel::Ultra));
-		zip.SetProperty(Zip::PropertyId::ThreadsCount, m_maxThreadCount);
-		zip.Write(*zipFiles);
+		archiveItems.memory -= size;
+		const ScopedCall memoryGuard([&] {
+			memoryBudget.Release(size);
+		});
 
+		size += LoadSpilledImages(archiveItems.spilled, isCover, images, memoryBudget);
+		hasError = ArchiveImages(settings, imageSettings.save, type, images) || hasError;
 		images.clear();
+	};
+
+	archiveImages(false, settings.image, Global::IMAGES);
+	archiveImages(true, settings.cover, Global::COVERS);
+
+	archiveItems.spilled.clear();
+	QDir(GetSpillFolder(settings.dstDir)).removeRecursively();
+
+	return hasError;
+}
+
+class BackgroundArchiver
+{
+	NON_COPY_MOVABLE(BackgroundArchiver)
+
+public:
+	using Task = std::function<bool()>;
+
+public:
+	BackgroundArchiver(const int maxArchiveCount, const qsizetype maxMemory)
+		: m_maxArchiveCount { std::max(maxArchiveCount, 0) }
+		, m_maxMemory { maxMemory }
+		, m_pool { { .threadCount = static_cast<unsigned>(std::max(maxArchiveCount, 1)), .maxQueueSize = static_cast<size_t>(std::max(maxArchiveCount, 1)) } }
+	{
 	}
 
-	void WriteImageStatistics()
+	~BackgroundArchiver()
 	{
-		ScopedCall clearGuard([this] {
-			m_imageStatistics.clear();
-		});
+		m_pool.wait();
+	}
 
-		if (!m_imageStatisticsStream)
-			return;
+public:
+	void Enqueue(QString archive, const qsizetype memory, Task task)
+	{
+		if (m_maxArchiveCount == 0)
+			return Finish(archive, 0, Execute(archive, task));
 
-		for (const auto& [folder, fileName, imageId, fail, isCover, size, width, height, schema, hash] : m_imageStatistics)
-			(*m_imageStatisticsStream) << folder << '|' << fileName << '|' << imageId << '|' << fail << '|' << (isCover ? 1 : 0) << '|' << static_cast<int>(schema) << '|' << size << '|' << width << '|'
-									   << height << '|' << hash << '\n';
+		{
+			std::unique_lock lock(m_guard);
+			m_condition.wait(lock, [&] {
+				return m_archiveCount == 0 || (m_archiveCount < m_maxArchiveCount && m_memory + memory <= m_maxMemory);
+			});
+			++m_archiveCount;
+			m_memory += memory;
+		}
 
-		m_imageStatisticsStream->flush();
+		m_pool.enqueue([this, archive = std::move(archive), memory, task = std::move(task)](auto) {
+			Finish(archive, memory, Execute(archive, task));
+		});
 	}
 
-private: // Worker::IClient
-	void OnWorkFinished(ImageStatistics imageStatistics, ImageItems covers, ImageItems images) override
+	QStringList Wait()
 	{
-		std::lock_guard lock(m_workClientGuard);
-		m_imageStatistics.reserve(m_imageStatistics.size() + imageStatistics.size());
-		std::ranges::move(std::move(imageStatistics), std::back_inserter(m_imageStatistics));
-		std::ranges::move(std::move(covers), std::back_inserter(m_covers));
-		std::ranges::move(std::move(images), std::back_inserter(m_images));
+		m_pool.wait();
+		std::lock_guard lock(m_guard);
+		return std::move(m_failed);
 	}
 
 private:
-	std::condition_variable& m_queueCondition;
-	std::mutex&              m_queueGuard;
-	std::atomic_bool         m_hasError { false };
-	DataItems                m_queue;
-	std::atomic_int          m_queueSize { 0 };
-	std::mutex               m_fileSystemGuard;
+	static bool Execute(const QString& archive, const Task& task)
+	{
+		try
+		{
+			return task();
+		}
+		catch (const std::exception& ex)
+		{
+			PLOGE << QString("%1 archiving failed: %2").arg(archive).arg(ex.what());
+		}
+		catch (...)
+		{
+			PLOGE << QString("%1 archiving failed").arg(archive);
+		}
 
-	std::mutex m_workClientGuard;
+		return true;
+	}
 
-	QDir       m_dstDir;
-	const bool m_saveCovers;
-	const bool m_saveImages;
-	const int  m_maxThreadCount;
+	void Finish(const QString& archive, const qsizetype memory, const bool hasError)
+	{
+		std::lock_guard lock(m_guard);
+		if (hasError)
+			m_failed << archive;
 
-	ImageStatistics m_imageStatistics;
-	ImageItems      m_covers;
-	ImageItems      m_images;
-	QTextStream*    m_imageStatisticsStream;
+		if (m_maxArchiveCount == 0)
+			return;
 
-	std::vector<std::unique_ptr<Worker>> m_workers;
+		--m_archiveCount;
+		m_memory -= memory;
+		m_condition.notify_all();
+	}
+
+private:
+	const int               m_maxArchiveCount;
+	const qsizetype         m_maxMemory;
+	std::mutex              m_guard;
+	std::condition_variable m_condition;
+	int                     m_archiveCount { 0 };
+	qsizetype               m_memory { 0 };
+	QStringList             m_failed;
+	Util::ThreadPool<>      m_pool;
 };
 
+QString GetFb2ArchiveFileName(const Settings& settings)
+{
+	return QString("%1.%2").arg(settings.dstDir.path(), Zip::FormatToString(settings.format));
+}
+
+QStringList GetOutputFiles(const Settings& settings)
+{
+	return { GetFb2ArchiveFileName(settings), GetImagesFolder(settings.dstDir, Global::IMAGES), GetImagesFolder(settings.dstDir, Global::COVERS) };
+}
+
+void RemoveIncompleteOutput(Settings settings, const QString& archive)
+{
+	settings.dstDir = QDir(settings.dstDir.filePath(QFileInfo(archive).completeBaseName()));
+	if (settings.dstDir.exists())
+	{
+		PLOGI << "removing incomplete output " << settings.dstDir.path();
+		settings.dstDir.removeRecursively();
+	}
+
+	if (QDir spillDir(GetSpillFolder(settings.dstDir)); spillDir.exists())
+	{
+		PLOGI << "removing incomplete output " << spillDir.path();
+		spillDir.removeRecursively();
+	}
+
+	for (const auto& file : GetOutputFiles(settings))
+		if (QFile::exists(file))
+		{
+			PLOGI << "removing incomplete output " << file;
+			QFile::remove(file);
+		}
+}
+
 bool ArchiveFb2External(const Settings& settings)
 {
 	if (!settings.saveFb2 || settings.archiver.isEmpty())
@@ -792,17 +1272,47 @@ bool ArchiveFb2External(const Settings& settings)
 	return hasErrors;
 }
 
-bool ArchiveFb2(const Settings& settings)
+void SaveFb2(const Settings& settings, DataItemList& fb2)
+{
+	if (fb2.empty())
+		return;
+
+	PLOGW << QString("saving %1 fb2 to %2").arg(fb2.size()).arg(settings.dstDir.path());
+	for (const auto& [fileName, body, dateTime] : fb2)
+		if (WriteOutputFile(settings.dstDir, fileName, body, dateTime))
+			PLOGE << "cannot save " << fileName;
+
+	fb2.clear();
+}
+
+bool ArchiveFb2(const Settings& settings, DataItemList& fb2)
 {
 	if (!settings.archiveFb2)
 		return false;
 
+	StageTimer timer(Stage::ArchiveFb2);
 	if (!settings.archiver.isEmpty())
 		return ArchiveFb2External(settings);
 
-	size_t epubCount = 0;
+	bool             archived = false;
+	const ScopedCall fb2Guard([&] {
+		if (!archived)
+			SaveFb2(settings, fb2);
+	});
+
+	const auto dstArchiveFileName = GetFb2ArchiveFileName(settings);
+	QFile::remove(dstArchiveFileName);
+
+	size_t                epubCount = 0;
+	FliLib::ArchiveWriter writer(dstArchiveFileName, settings.format);
+	for (const auto& item : fb2)
+	{
+		if (item.fileName.endsWith(".epub", Qt::CaseInsensitive))
+			++epubCount;
+
+		writer.Append(item.fileName, item.body, item.dateTime);
+	}
 
-	auto zipFiles = Zip::CreateZipFileController();
 	for (QDirIterator it(settings.dstDir.path(), QStringList() << "*", QDir::Files, QDirIterator::Subdirectories); it.hasNext();)
 	{
 		const auto file = it.next();
@@ -816,37 +1326,52 @@ bool ArchiveFb2(const Settings& settings)
 		if (file.endsWith(".epub", Qt::CaseInsensitive))
 			++epubCount;
 
-		zipFiles->AddFile(settings.dstDir.relativeFilePath(file), stream.readAll(), QFileInfo(file).birthTime());
+		writer.Append(settings.dstDir.relativeFilePath(file), stream.readAll(), QFileInfo(file).birthTime());
 	}
 
-	if (zipFiles->GetCount() == 0)
+	if (writer.GetCount() == 0)
 	{
 		PLOGW << "No text files found";
 		return false;
 	}
 
-	const auto dstArchiveFileName = QString("%1.%2").arg(settings.dstDir.path(), Zip::FormatToString(settings.format));
-	PLOGI << "archive " << dstArchiveFileName << ", total: " << zipFiles->GetCount();
+	PLOGI << "archive " << dstArchiveFileName << ", total: " << writer.GetCount();
 
-	QFile::remove(dstArchiveFileName);
+	const auto isEpub = epubCount * 10 > 9 * writer.GetCount();
 
-	const auto isEpub = epubCount * 10 > 9 * zipFiles->GetCount();
-
-	Zip zip(dstArchiveFileName, settings.format);
-	zip.SetProperty(Zip::PropertyId::CompressionLevel, QVariant::fromValue(isEpub ? Zip::CompressionLevel::None : Zip::CompressionLevel::Ultra));
-	zip.SetProperty(Zip::PropertyId::SolidArchive, false);
-	zip.SetProperty(Zip::PropertyId::ThreadsCount, settings.maxThreadCount);
+	writer.SetProperty(Zip::PropertyId::CompressionLevel, QVariant::fromValue(isEpub ? Zip::CompressionLevel::None : Zip::CompressionLevel::Ultra));
+	writer.SetProperty(Zip::PropertyId::SolidArchive, false);
+	writer.SetProperty(Zip::PropertyId::ThreadsCount, settings.maxThreadCount);
 	if (settings.format == Zip::Format::SevenZip)
-		zip.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(isEpub ? Zip::CompressionMethod::Copy : Zip::CompressionMethod::Ppmd));
+		writer.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(isEpub ? Zip::CompressionMethod::Copy : Zip::CompressionMethod::Ppmd));
 
-	const auto result = zip.Write(*zipFiles);
+	const auto result = writer.Finalize();
 	if (result)
+	{
+		archived = true;
+		fb2.clear();
 		QDir(settings.dstDir).removeRecursively();
+	}
+
+	timer.SetBytesOut(QFileInfo(dstArchiveFileName).size());
 
 	return !result;
 }
 
-bool ProcessArchiveImpl(const QString& archive, Settings settings, const IEncodingDetector& encodingDetector, Util::Progress& progress, QTextStream* imageStatisticsStream, const Decoder& decoder)
+bool ProcessArchiveImpl(
+	const QString&           archive,
+	Settings                 settings,
+	const IEncodingDetector& encodingDetector,
+	Util::Progress&          progress,
+	ImageStatisticsWriter*   imageStatisticsWriter,
+	const Decoder&           decoder,
+	EncodeCache*             encodeCache,
+	EncodePredictor*         encodePredictor,
+	ImageRepairer*           imageRepairer,
+	MemoryBudget&            memoryBudget,
+	BackgroundArchiver&      archiver,
+	Journal&                 journal
+)
 {
 	const QFileInfo fileInfo(archive);
 	settings.dstDir = QDir(settings.dstDir.filePath(fileInfo.completeBaseName()));
@@ -856,77 +1381,105 @@ bool ProcessArchiveImpl(const QString& archive, Settings settings, const IEncodi
 		return true;
 	}
 
-	const Zip  zip(archive);
-	auto       fileList         = zip.GetFileNameList() | std::views::reverse | std::ranges::to<QStringList>();
-	const auto fileListCount    = static_cast<size_t>(fileList.size());
-	const auto currentFileCount = progress.GetCount();
+	const Zip             zip(archive);
+	FliLib::ArchiveReader reader(zip);
+	const auto            fileListCount    = reader.GetCount();
+	const auto            currentFileCount = progress.GetCount();
 	PLOGI << QString("%1 processing, total files: %2").arg(fileInfo.fileName()).arg(fileListCount);
 
-	auto hasError = [&] {
+	const auto   stageStatistics = GetStageStatistics().GetSnapshot();
+	ArchiveItems archiveItems;
+	const auto   hasError = [&] {
 		const auto maxThreadCount = std::min(std::max(settings.maxThreadCount, 1), static_cast<int>(fileListCount));
 
-		std::condition_variable queueCondition;
-		std::mutex              queueGuard;
-		FileProcessor           fileProcessor(settings, fileInfo.completeBaseName(), encodingDetector, queueCondition, queueGuard, maxThreadCount, progress, imageStatisticsStream, decoder);
+		FileProcessor fileProcessor(settings, fileInfo.completeBaseName(), encodingDetector, maxThreadCount, progress, decoder, encodeCache, encodePredictor, imageRepairer, memoryBudget);
+
+		const auto canEnqueue = [&] {
+			const auto queueSize = fileProcessor.GetQueueSize();
+			return queueSize < static_cast<size_t>(maxThreadCount) * 2 && (queueSize == 0 || memoryBudget.IsAvailable(static_cast<qsizetype>(reader.GetFileSize())));
+		};
 
-		while (!fileList.isEmpty())
+		while (reader.Next())
 		{
-			if (fileProcessor.GetQueueSize() < maxThreadCount * 2)
+			if (!canEnqueue())
+				fileProcessor.WaitForQueue(canEnqueue);
+
+			auto body = [&] {
+				StageTimer timer(Stage::ZipRead, static_cast<qint64>(reader.GetFileSize()));
+				auto       result = reader.Read();
+				timer.SetBytesOut(result.size());
+				return result;
+			}();
+			if (!body.isEmpty())
 			{
-				const auto input = zip.Read(fileList.front());
-				auto       body  = input->GetStream().readAll();
-				if (!body.isEmpty())
-				{
-					fileProcessor.Enqueue(std::move(fileList.front()), std::move(body), zip.GetFileTime(fileList.front()));
-				}
-				else
-				{
-					PLOGW << fileList.front() << " is empty";
-					progress.Increment(1, fileList.front().toStdString());
-				}
-				fileList.pop_front();
+				fileProcessor.Enqueue(reader.GetFileName(), std::move(body), reader.GetFileTime());
 			}
 			else
 			{
-				std::unique_lock lockStart(queueGuard);
-				queueCondition.wait(lockStart, [&]() {
-					return fileProcessor.GetQueueSize() < maxThreadCount * 2;
-				});
+				PLOGW << reader.GetFileName() << " is empty";
+				progress.Increment(1, reader.GetFileName().toStdString());
 			}
 		}
 
-		for (int i = 0; i < maxThreadCount; ++i)
-			fileProcessor.Enqueue({}, {}, {});
-
-		fileProcessor.Wait();
+		archiveItems = fileProcessor.Wait();
 
 		return fileProcessor.HasError();
 	}();
 
-	hasError = ArchiveFb2(settings) || hasError;
-
-	QDir().rmdir(settings.dstDir.path());
+	PLOGI << QString("%1 stages:\n").arg(fileInfo.fileName()) << StageStatistics::ToString(StageStatistics::Subtract(GetStageStatistics().GetSnapshot(), stageStatistics));
 
-	const auto fileCount = progress.GetCount();
-	if (fileCount - currentFileCount != fileListCount)
+	const auto processedCount = progress.GetCount() - currentFileCount;
+	if (processedCount != fileListCount)
 	{
-		PLOGE << QString("something strange: %1 files in archive %2 but processed %3").arg(fileListCount).arg(fileInfo.fileName()).arg(fileCount - currentFileCount);
+		PLOGE << QString("something strange: %1 files in archive %2 but processed %3").arg(fileListCount).arg(fileInfo.fileName()).arg(processedCount);
 	}
 
-	const auto resultReport = QString("%1 (%2 of %3 files) processed %4").arg(fileInfo.fileName()).arg(fileCount - currentFileCount).arg(fileListCount).arg(hasError ? "with errors" : "successfully");
-	if (hasError)
-		PLOGW << resultReport;
-	else
-		PLOGI << resultReport;
+	const auto memory = archiveItems.memory + archiveItems.spilledSize;
+	archiver.Enqueue(archive, memory, [=, &memoryBudget, &journal, settings = std::move(settings), archiveItems = std::move(archiveItems)]() mutable {
+		const ScopedCall memoryGuard([&] {
+			memoryBudget.Release(archiveItems.memory);
+		});
 
-	return hasError;
+		const auto imagesHaveError = ArchiveImages(settings, archiveItems, memoryBudget);
+		const auto archiveHasError = ArchiveFb2(settings, archiveItems.fb2) || imagesHaveError || hasError;
+
+		QDir().rmdir(settings.dstDir.path());
+
+		journal.Commit(archive, archiveHasError, GetOutputFiles(settings), [&] {
+			return imageStatisticsWriter ? imageStatisticsWriter->Write(fileInfo.completeBaseName(), std::move(archiveItems.imageStatistics)) : -1;
+		});
+
+		const auto resultReport =
+			QString("%1 (%2 of %3 files) processed %4").arg(fileInfo.fileName()).arg(processedCount).arg(fileListCount).arg(archiveHasError ? "with errors" : "successfully");
+		if (archiveHasError)
+			PLOGW << resultReport;
+		else
+			PLOGI << resultReport;
+
+		return archiveHasError;
+	});
+
+	return false;
 }
 
-bool ProcessArchive(const QString& file, const Settings& settings, const IEncodingDetector& encodingDetector, Util::Progress& progress, QTextStream* imageStatisticsStream, const Decoder& decoder)
+bool ProcessArchive(
+	const QString&           file,
+	const Settings&          settings,
+	const IEncodingDetector& encodingDetector,
+	Util::Progress&          progress,
+	ImageStatisticsWriter*   imageStatisticsWriter,
+	const Decoder&           decoder,
+	EncodeCache*             encodeCache,
+	EncodePredictor*         encodePredictor,
+	ImageRepairer*           imageRepairer,
+	MemoryBudget&            memoryBudget,
+	BackgroundArchiver&      archiver,
+	Journal&                 journal
+)
 {
 	try
 	{
-		return ProcessArchiveImpl(file, settings, encodingDetector, progress, imageStatisticsStream, decoder);
+		return ProcessArchiveImpl(file, settings, encodingDetector, progress, imageStatisticsWriter, decoder, encodeCache, encodePredictor, imageRepairer, memoryBudget, archiver, journal);
 	}
 	catch (const std::exception& ex)
 	{
@@ -964,34 +1517,61 @@ QStringList ProcessArchives(Settings& settings)
 		return std::make_pair(match.hasMatch() ? match.captured(1).toInt() : 0, std::move(file));
 	});
 
-	PLOGD << "Total file count calculation";
-	settings.totalFileCount = std::accumulate(sorted.cbegin(), sorted.cend(), settings.totalFileCount, [](const auto init, const auto& item) {
-		const Zip zip(item.second);
-		return init + zip.GetFileNameList().size();
-	});
-	PLOGI << "Total file count: " << settings.totalFileCount;
+	Journal journal(settings.dstDir, settings.resume);
 
-	std::unique_ptr<QTextStream> imageStatisticsStream;
-	QFile                        imageStatisticsFile(settings.imageStatistics);
-	if (!settings.imageStatistics.isEmpty())
+	QStringList failed;
+	if (settings.resume)
 	{
-		if (!imageStatisticsFile.open(QIODevice::Append))
-			throw std::ios_base::failure(QString("Cannot write to %1").arg(settings.imageStatistics).toStdString());
-		imageStatisticsStream = std::make_unique<QTextStream>(&imageStatisticsFile);
-		*imageStatisticsStream << "#ARCHIVE|FB2_FILE|IMAGE_ID|FAIL_INFO|IS_COVER|PIXEL_TYPE|IMAGE_FILE_SIZE|WIDTH|HEIGHT|HASH\n";
-		imageStatisticsStream->flush();
+		std::erase_if(sorted, [&](const auto& item) {
+			const auto hasError = journal.IsCompleted(item.second);
+			if (!hasError)
+				return RemoveIncompleteOutput(settings, item.second), false;
+
+			PLOGI << QString("%1 already processed, skipped").arg(QFileInfo(item.second).fileName());
+			if (*hasError)
+				failed << item.second;
+
+			return true;
+		});
 	}
 
+	PLOGD << "Total file count calculation";
+	settings.totalFileCount += static_cast<int>(FliLib::GetFileCount(sorted | std::views::values | std::ranges::to<QStringList>()));
+	PLOGI << "Total file count: " << settings.totalFileCount;
+	PLOGI << "Pixel kernels: " << FliLib::GetPixelKernelsIsa();
+
+	const auto imageStatisticsWriter = settings.NeedImageStatistics() ? std::make_unique<ImageStatisticsWriter>(settings, journal) : std::unique_ptr<ImageStatisticsWriter> {};
+
 	const Decoder decoder;
 	const auto    encodingDetector = IEncodingDetector::Create();
+	const auto    encodeCache      = settings.encodeCache.isEmpty() ? std::unique_ptr<EncodeCache> {} : std::make_unique<EncodeCache>(settings.encodeCache, static_cast<qint64>(settings.encodeCacheSize) * 1024 * 1024);
+	const auto    encodePredictor  = settings.encodeHistory.isEmpty() ? std::unique_ptr<EncodePredictor> {} : std::make_unique<EncodePredictor>(settings.encodeHistory, settings.encodeCalibration);
+	const auto    imageRepairer    = settings.ffmpeg.isEmpty() ? std::unique_ptr<ImageRepairer> {} : std::make_unique<ImageRepairer>(settings.ffmpeg, settings.ffmpegWorkerCount, settings.ffmpegTimeout);
 
 	Util::Progress progress(settings.totalFileCount, "repacking e-library");
 
-	QStringList failed;
+	MemoryBudget       memoryBudget(static_cast<qsizetype>(settings.memoryBudget) * 1024 * 1024);
+	BackgroundArchiver archiver(settings.backgroundArchiveCount, static_cast<qsizetype>(settings.backgroundArchiveMemoryLimit) * 1024 * 1024);
+
 	for (auto&& file : sorted | std::views::values | std::views::reverse)
-		if (ProcessArchive(file, settings, *encodingDetector, progress, imageStatisticsStream.get(), decoder))
+		if (ProcessArchive(file, settings, *encodingDetector, progress, imageStatisticsWriter.get(), decoder, encodeCache.get(), encodePredictor.get(), imageRepairer.get(), memoryBudget, archiver, journal))
 			failed << std::move(file);
 
+	failed << archiver.Wait();
+
+	const auto validation = GetValidationStatistics();
+	PLOGI << QString("fb2 validation: %1 well-formed by fast scan, %2 passed validator, %3 fixed, %4 failed").arg(validation.wellFormed).arg(validation.validated).arg(validation.fixed).arg(validation.failed);
+
+	const auto stageStatistics = GetStageStatistics().GetSnapshot();
+	PLOGI << "stages:\n" << StageStatistics::ToString(stageStatistics);
+	if (!settings.stageStatistics.isEmpty())
+	{
+		if (QFile file(settings.stageStatistics); file.open(QIODevice::WriteOnly))
+			file.write(StageStatistics::ToJson(stageStatistics));
+		else
+			PLOGE << "Cannot write " << settings.stageStatistics;
+	}
+
 	return failed;
 }
 
@@ -1058,7 +1638,12 @@ Settings ProcessCommandLine(const QCoreApplication& app)
 		{
 			{ { "o", FOLDER }, "Output folder (required)", FOLDER },
 			{ { QString(QUALITY[0]), QUALITY_OPTION_NAME }, "Compression quality [0, 100] or -1 for default compression quality", QUALITY },
-			{ { QString(THREADS[0]), MAX_THREAD_COUNT_OPTION_NAME }, "Maximum number of CPU threads", QString(THREADS).arg(settings.maxThreadCount) },
+			{ { QString(THREADS[0]), MAX_THREAD_COUNT_OPTION_NAME }, "Maximum number of parser threads, half of CPU threads by default", QString(THREADS).arg(settings.maxThreadCount) },
+			{ ENCODER_THREAD_COUNT_OPTION_NAME, "Maximum number of image encoder threads, same as parser threads by default", QString(THREADS).arg(settings.encoderThreadCount) },
+			{ BACKGROUND_ARCHIVES_OPTION_NAME, "Maximum number of archives compressed in background while the next one is processed, 0 disables background compression", QString("count [%1]").arg(settings.backgroundArchiveCount) },
+			{ BACKGROUND_ARCHIVES_MEMORY_OPTION_NAME, "Maximum size of images waiting for background compression, MB", QString("size [%1]").arg(settings.backgroundArchiveMemoryLimit) },
+			{ MEMORY_BUDGET_OPTION_NAME, "Maximum size of input files, fb2 and images held in memory, images beyond it are spilled to disk, MB. 0 means unlimited", QString("size [%1]").arg(settings.memoryBudget) },
+			{ FB2_MEMORY_LIMIT_OPTION_NAME, "Maximum size of fb2 kept in memory for the embedded archiver per archive, the rest is written to the output folder, MB. 0 writes all fb2 to the output folder", QString("size [%1]").arg(settings.fb2MemoryLimit) },
 			{ { QString(FORMAT[0]), FORMAT }, "Output fb2 archive format [7z | zip]", QString("%1 [%2]").arg(FORMAT, "7z") },
 			{ { QString(ARCHIVER_OPTION_NAME[0]), ARCHIVER_OPTION_NAME }, "Path to external archiver executable", QString("%1 [embedded zip archiver]").arg(PATH) },
 
@@ -1071,16 +1656,27 @@ Settings ProcessCommandLine(const QCoreApplication& app)
 
 			{ MIN_IMAGE_FILE_SIZE_OPTION_NAME, "Minimum image file size threshold for writing to error folder", QString("size [%1]").arg(settings.minImageFileSize) },
 			{ FFMPEG_OPTION_NAME, "Path to ffmpeg executable", PATH },
+			{ FFMPEG_WORKERS_OPTION_NAME, "Maximum number of concurrent ffmpeg processes repairing damaged images", QString("count [%1]").arg(settings.ffmpegWorkerCount) },
+			{ FFMPEG_TIMEOUT_OPTION_NAME, "ffmpeg timeout per image, s", QString("timeout [%1]").arg(settings.ffmpegTimeout) },
 			{ IMAGE_STATISTICS, "Image statistics output path", PATH },
+			{ IMAGE_STATISTICS_DB, "Image statistics SQLite database path, flistat schema", PATH },
+			{ STAGE_STATISTICS, "Per-stage timing report output path, json", PATH },
+			{ ENCODE_CACHE, "Encoded images cache folder, shared between runs", PATH },
+			{ ENCODE_CACHE_SIZE, "Encoded images cache size limit, least recently used entries are evicted beyond it, MB. 0 means unlimited", QString("size [%1]").arg(settings.encodeCacheSize) },
+			{ ENCODE_HISTORY, "Encoding results history file, used to skip encoding images which are unlikely to shrink", PATH },
+			{ ENCODE_CALIBRATION, "Encode every Nth image predicted to be skipped to count false skips, 1 encodes all images and only collects history", QString("rate [%1]").arg(settings.encodeCalibration) },
+			{ HASH_ALGORITHM_OPTION_NAME, QString("Image hash algorithm [%1]").arg(FliLib::Hash::GetAlgorithms().join(" | ")), QString("algorithm [%1]").arg(settings.hashAlgorithm) },
 
 			{ { QString(GRAYSCALE_OPTION_NAME[0]), GRAYSCALE_OPTION_NAME }, "Convert all images to grayscale" },
 			{ COVER_GRAYSCALE_OPTION_NAME, "Convert covers to grayscale" },
 			{ IMAGE_GRAYSCALE_OPTION_NAME, "Convert images to grayscale" },
+			{ JPEG_TRANSCODE_OPTION_NAME, "Recompress unscaled jpeg images to jpeg xl losslessly, without decoding pixels" },
 
 			{ NO_ARCHIVE_FB2_OPTION_NAME, "Don't archive fb2" },
 			{ NO_FB2_OPTION_NAME, "Don't save fb2" },
 			{ NO_IMAGES_OPTION_NAME, "Don't save image" },
 			{ COVERS_ONLY_OPTION_NAME, "Save covers only" },
+			{ RESUME, "Skip archives completed by the previous run and clean up the incomplete ones" },
     }
 	);
 
@@ -1114,10 +1710,27 @@ Settings ProcessCommandLine(const QCoreApplication& app)
 	SetValue(parser, COVER_QUALITY_OPTION_NAME, settings.cover.quality);
 	SetValue(parser, IMAGE_QUALITY_OPTION_NAME, settings.image.quality);
 
-	SetValue(parser, MAX_THREAD_COUNT_OPTION_NAME, settings.maxThreadCount);
+	if (SetValue(parser, MAX_THREAD_COUNT_OPTION_NAME, settings.maxThreadCount))
+		settings.encoderThreadCount = settings.maxThreadCount;
+	SetValue(parser, ENCODER_THREAD_COUNT_OPTION_NAME, settings.encoderThreadCount);
+	SetValue(parser, BACKGROUND_ARCHIVES_OPTION_NAME, settings.backgroundArchiveCount);
+	SetValue(parser, BACKGROUND_ARCHIVES_MEMORY_OPTION_NAME, settings.backgroundArchiveMemoryLimit);
+	SetValue(parser, FB2_MEMORY_LIMIT_OPTION_NAME, settings.fb2MemoryLimit);
+	SetValue(parser, MEMORY_BUDGET_OPTION_NAME, settings.memoryBudget);
 	SetValue(parser, MIN_IMAGE_FILE_SIZE_OPTION_NAME, settings.minImageFileSize);
+	SetValue(parser, FFMPEG_WORKERS_OPTION_NAME, settings.ffmpegWorkerCount);
+	SetValue(parser, FFMPEG_TIMEOUT_OPTION_NAME, settings.ffmpegTimeout);
+	SetValue(parser, ENCODE_CALIBRATION, settings.encodeCalibration);
+	SetValue(parser, ENCODE_CACHE_SIZE, settings.encodeCacheSize);
+
+	settings.imageStatistics   = parser.value(IMAGE_STATISTICS);
+	settings.imageStatisticsDb = parser.value(IMAGE_STATISTICS_DB);
+	settings.stageStatistics   = parser.value(STAGE_STATISTICS);
+	settings.encodeCache       = parser.value(ENCODE_CACHE);
+	settings.encodeHistory     = parser.value(ENCODE_HISTORY);
 
-	settings.imageStatistics = parser.value(IMAGE_STATISTICS);
+	if (parser.isSet(HASH_ALGORITHM_OPTION_NAME))
+		settings.hashAlgorithm = parser.value(HASH_ALGORITHM_OPTION_NAME).toLower();
 
 	settings.cover.grayscale = settings.image.grayscale = parser.isSet(GRAYSCALE_OPTION_NAME);
 	if (parser.isSet(COVER_GRAYSCALE_OPTION_NAME))
@@ -1125,8 +1738,10 @@ Settings ProcessCommandLine(const QCoreApplication& app)
 	if (parser.isSet(IMAGE_GRAYSCALE_OPTION_NAME))
 		settings.image.grayscale = true;
 
-	settings.saveFb2    = !parser.isSet(NO_FB2_OPTION_NAME);
-	settings.archiveFb2 = settings.saveFb2 && !parser.isSet(NO_ARCHIVE_FB2_OPTION_NAME);
+	settings.resume        = parser.isSet(RESUME);
+	settings.jpegTranscode = parser.isSet(JPEG_TRANSCODE_OPTION_NAME);
+	settings.saveFb2       = !parser.isSet(NO_FB2_OPTION_NAME);
+	settings.archiveFb2    = settings.saveFb2 && !parser.isSet(NO_ARCHIVE_FB2_OPTION_NAME);
 
 	settings.cover.save = settings.image.save = !parser.isSet(NO_IMAGES_OPTION_NAME);
 	settings.image.save                       = settings.image.save && !parser.isSet(COVERS_ONLY_OPTION_NAME);
@@ -1164,6 +1779,9 @@ bool run(int argc, char* argv[])
 	checkExternalUtil("ffmpeg", settings.ffmpeg);
 	checkExternalUtil("external archiver", settings.archiver);
 
+	if (!FliLib::Hash::GetAlgorithms().contains(settings.hashAlgorithm))
+		throw std::invalid_argument(QString("%1 must be %2").arg(HASH_ALGORITHM_OPTION_NAME, FliLib::Hash::GetAlgorithms().join(" | ")).toStdString());
+
 	const auto failedArchives = ProcessArchives(settings);
 	if (failedArchives.isEmpty())
 		return false;
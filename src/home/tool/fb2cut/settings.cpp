@@ -29,13 +29,39 @@ std::ostream& operator<<(std::ostream& stream, const HomeCompa::fb2cut::Settings
 	else
 		stream << std::endl << "fb2 archiving " << (settings.archiveFb2 ? "enabled" : "disabled");
 
+	if (settings.resume)
+		stream << std::endl << "resume enabled";
+
+	if (settings.jpegTranscode)
+		stream << std::endl << "jpeg transcoding enabled";
+
 	if (!settings.imageStatistics.isEmpty())
 		stream << std::endl << settings.imageStatistics.toStdString();
 
+	if (!settings.imageStatisticsDb.isEmpty())
+		stream << std::endl << "image statistics database: " << settings.imageStatisticsDb.toStdString();
+
+	if (!settings.stageStatistics.isEmpty())
+		stream << std::endl << "stage statistics: " << settings.stageStatistics.toStdString();
+
+	if (!settings.encodeCache.isEmpty())
+		stream << std::endl << "encode cache: " << settings.encodeCache.toStdString() << ", size limit, MB: " << settings.encodeCacheSize;
+
+	if (!settings.encodeHistory.isEmpty())
+		stream << std::endl << "encode history: " << settings.encodeHistory.toStdString() << ", calibration rate: " << settings.encodeCalibration;
+
+	stream << std::endl << "hash algorithm: " << settings.hashAlgorithm.toStdString();
 	stream << std::endl << "output format: " << settings.format;
 
 	if (!settings.ffmpeg.isEmpty())
-		stream << std::endl << "ffmpeg: " << settings.ffmpeg.toStdString();
+		stream << std::endl << "ffmpeg: " << settings.ffmpeg.toStdString() << ", workers: " << settings.ffmpegWorkerCount << ", timeout, s: " << settings.ffmpegTimeout;
 
-	return stream << std::endl << "max thread count: " << settings.maxThreadCount << std::endl << "min image file size: " << settings.minImageFileSize;
+	return stream << std::endl
+	              << "max thread count: " << settings.maxThreadCount << std::endl
+	              << "encoder thread count: " << settings.encoderThreadCount << std::endl
+	              << "background archive count: " << settings.backgroundArchiveCount << std::endl
+	              << "background archive memory limit, MB: " << settings.backgroundArchiveMemoryLimit << std::endl
+	              << "fb2 memory limit, MB: " << settings.fb2MemoryLimit << std::endl
+	              << "memory budget, MB: " << settings.memoryBudget << std::endl
+	              << "min image file size: " << settings.minImageFileSize;
 }
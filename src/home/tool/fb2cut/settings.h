@@ -1,11 +1,14 @@
 #pragma once
 
+#include <algorithm>
 #include <thread>
 
 #include <QDir>
 #include <QSize>
 #include <QString>
 
+#include "lib/Hash.h"
+
 #include "Constant.h"
 #include "zip.h"
 
@@ -46,18 +49,39 @@ struct Settings
 {
 	QStringList   inputWildcards;
 	ImageSettings cover { Global::COVER, &GetCoverFileName }, image { Global::IMAGE, &GetImageFileName };
-	int           maxThreadCount { static_cast<int>(std::thread::hardware_concurrency()) };
+	int           maxThreadCount { std::max(static_cast<int>(std::thread::hardware_concurrency()) / 2, 1) };
+	int           encoderThreadCount { maxThreadCount };
+	int           backgroundArchiveCount { 1 };
+	int           backgroundArchiveMemoryLimit { 4096 };
+	int           fb2MemoryLimit { 2048 };
+	int           memoryBudget { 0 };
 	int           minImageFileSize { 1024 };
+	int           ffmpegWorkerCount { 2 };
+	int           ffmpegTimeout { 60 };
+	int           encodeCalibration { 16 };
+	int           encodeCacheSize { 10240 };
 	bool          saveFb2 { true };
 	bool          archiveFb2 { true };
+	bool          resume { false };
+	bool          jpegTranscode { false };
 	QDir          dstDir;
 	QString       ffmpeg;
 	QString       imageStatistics;
+	QString       imageStatisticsDb;
+	QString       stageStatistics;
+	QString       encodeCache;
+	QString       encodeHistory;
+	QString       hashAlgorithm { FliLib::HASH_MD5 };
 	QString       archiver;
 	QString       archiverOptions;
 	int           totalFileCount { 0 };
 	Zip::Format   format { Zip::Format::SevenZip };
 	QString       logFileName;
+
+	bool NeedImageStatistics() const noexcept
+	{
+		return !imageStatistics.isEmpty() || !imageStatisticsDb.isEmpty();
+	}
 };
 
 } // namespace HomeCompa::fb2cut
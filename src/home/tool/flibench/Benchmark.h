@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <vector>
+
+#include <QSize>
+#include <QString>
+
+namespace HomeCompa::flibench
+{
+
+struct Options
+{
+	int                       iterations { 20 };
+	QSize                     size { 2048, 2048 };
+	std::vector<int>          threads;
+	int                       itemCount { 100'000 };
+	std::chrono::microseconds work { 2 };
+};
+
+template <typename Functor>
+double Measure(const int iterations, Functor&& functor)
+{
+	auto result = std::numeric_limits<double>::max();
+	for (int i = 0; i < std::max(iterations, 1); ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		functor();
+		result = std::min(result, std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	return result;
+}
+
+QString FormatComparison(const QString& name, double baseline, double value, double megabytes);
+
+void RunPixelKernels(const Options& options);
+void RunQueue(const Options& options);
+
+} // namespace HomeCompa::flibench
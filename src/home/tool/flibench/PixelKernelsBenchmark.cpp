@@ -0,0 +1,128 @@
+#include <cstdlib>
+#include <random>
+
+#include <QBuffer>
+#include <QImage>
+
+#include "lib/Hash.h"
+#include "lib/PixelKernels.h"
+#include "util/ImageUtil.h"
+
+#include "Benchmark.h"
+#include "log.h"
+
+using namespace HomeCompa::flibench;
+using namespace HomeCompa;
+
+namespace
+{
+
+QImage CreateImage(const QSize& size, const QImage::Format format)
+{
+	QImage       image(size, format);
+	std::mt19937 random(static_cast<std::mt19937::result_type>(size.width() * size.height()));
+	for (int h = 0, height = image.height(); h < height; ++h)
+	{
+		auto* line = reinterpret_cast<QRgb*>(image.scanLine(h));
+		for (int w = 0, width = image.width(); w < width; ++w)
+			line[w] = static_cast<QRgb>(random()) | 0xFF000000U;
+	}
+	return image;
+}
+
+int GetMaxDifference(const QImage& lhs, const QImage& rhs)
+{
+	int result = 0;
+	for (int h = 0, height = lhs.height(); h < height; ++h)
+	{
+		const auto* lhsLine = lhs.constScanLine(h);
+		const auto* rhsLine = rhs.constScanLine(h);
+		for (int w = 0, width = lhs.width(); w < width; ++w)
+			result = std::max(result, std::abs(static_cast<int>(lhsLine[w]) - static_cast<int>(rhsLine[w])));
+	}
+	return result;
+}
+
+void RunGrayscale(const Options& options)
+{
+	const auto image     = CreateImage(options.size, QImage::Format_RGB32);
+	const auto megabytes = static_cast<double>(image.sizeInBytes()) / 1024 / 1024;
+
+	QImage     qtResult, kernelResult;
+	const auto qt = Measure(options.iterations, [&] {
+		qtResult = image.convertToFormat(QImage::Format_Grayscale8);
+	});
+	const auto kernel = Measure(options.iterations, [&] {
+		kernelResult = FliLib::ToGrayscale(image);
+	});
+
+	PLOGI << FormatComparison("grayscale", qt, kernel, megabytes);
+	PLOGI << QString("grayscale: kernel output differs from Qt by up to %1 levels").arg(GetMaxDifference(qtResult, kernelResult));
+}
+
+void RunOpaqueAlpha(const Options& options)
+{
+	const auto image     = CreateImage(options.size, QImage::Format_ARGB32);
+	const auto megabytes = static_cast<double>(image.sizeInBytes()) / 1024 / 1024;
+
+	QByteArray body;
+	{
+		QBuffer buffer(&body);
+		buffer.open(QIODevice::WriteOnly);
+		image.save(&buffer, "PNG");
+	}
+
+	QImage     result;
+	const auto qt = Measure(options.iterations, [&] {
+		result = Util::HasAlpha(image, body.constData());
+	});
+	const auto kernel = Measure(options.iterations, [&] {
+		if (result = FliLib::DropOpaqueAlpha(image); result.hasAlphaChannel())
+			result = Util::HasAlpha(result, body.constData());
+	});
+
+	PLOGI << FormatComparison("opaque alpha", qt, kernel, megabytes);
+}
+
+void RunPixelHash(const Options& options, const QString& algorithm)
+{
+	const auto image     = CreateImage(options.size, QImage::Format_RGB32);
+	const auto megabytes = static_cast<double>(image.sizeInBytes()) / 1024 / 1024;
+	const auto rowSize   = static_cast<qsizetype>(image.width()) * 4;
+
+	FliLib::Hash hash(algorithm);
+	QByteArray   qtResult, kernelResult;
+
+	const auto qt = Measure(options.iterations, [&] {
+		hash.Reset();
+		for (int h = 0, height = image.height(); h < height; ++h)
+			hash.AddData(QByteArrayView { reinterpret_cast<const char*>(image.constScanLine(h)), rowSize });
+		qtResult = hash.Result();
+	});
+	const auto kernel = Measure(options.iterations, [&] {
+		hash.Reset();
+		FliLib::AddPixelData(hash, image, 4);
+		kernelResult = hash.Result();
+	});
+
+	PLOGI << FormatComparison(QString("%1 pixel hash").arg(algorithm), qt, kernel, megabytes);
+	if (qtResult != kernelResult)
+		PLOGE << QString("%1 pixel hash: results differ").arg(algorithm);
+}
+
+} // namespace
+
+namespace HomeCompa::flibench
+{
+
+void RunPixelKernels(const Options& options)
+{
+	PLOGI << QString("pixel kernels: %1, image %2x%3, best of %4").arg(FliLib::GetPixelKernelsIsa()).arg(options.size.width()).arg(options.size.height()).arg(options.iterations);
+
+	RunGrayscale(options);
+	RunOpaqueAlpha(options);
+	for (const auto& algorithm : FliLib::Hash::GetAlgorithms())
+		RunPixelHash(options, algorithm);
+}
+
+} // namespace HomeCompa::flibench
@@ -0,0 +1,158 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "lib/WorkQueue.h"
+
+#include "Benchmark.h"
+#include "log.h"
+
+using namespace HomeCompa::flibench;
+using namespace HomeCompa;
+
+namespace
+{
+
+// the fb2cut input queue before WorkQueue: one mutex and one condition variable shared by the reader and all workers, notify_all on every event, one empty item per worker to stop
+template <typename T>
+class LegacyQueue
+{
+public:
+	explicit LegacyQueue(const int threadCount)
+		: m_threadCount { threadCount }
+	{
+	}
+
+	size_t GetSize() const noexcept
+	{
+		return static_cast<size_t>(m_size.load());
+	}
+
+	void Push(T item)
+	{
+		std::unique_lock lock(m_guard);
+		m_items.emplace(std::move(item));
+		++m_size;
+		m_condition.notify_all();
+	}
+
+	std::optional<T> Pop()
+	{
+		std::unique_lock lock(m_guard);
+		m_condition.wait(lock, [&] {
+			return !m_items.empty();
+		});
+
+		auto item = std::move(m_items.front());
+		m_items.pop();
+		--m_size;
+		m_condition.notify_all();
+		return item;
+	}
+
+	void Close()
+	{
+		std::unique_lock lock(m_guard);
+		for (int i = 0; i < m_threadCount; ++i)
+			m_items.emplace(std::nullopt);
+		m_condition.notify_all();
+	}
+
+	template <typename Predicate>
+	void WaitUntil(Predicate predicate)
+	{
+		std::unique_lock lock(m_guard);
+		m_condition.wait(lock, std::move(predicate));
+	}
+
+	void NotifyChanged()
+	{
+		m_condition.notify_all();
+	}
+
+private:
+	const int                    m_threadCount;
+	std::mutex                   m_guard;
+	std::condition_variable      m_condition;
+	std::queue<std::optional<T>> m_items;
+	std::atomic_int              m_size { 0 };
+};
+
+size_t GetCapacity(const int threadCount)
+{
+	return static_cast<size_t>(threadCount) * 2;
+}
+
+void Spin(const std::chrono::microseconds duration)
+{
+	const auto end = std::chrono::steady_clock::now() + duration;
+	while (std::chrono::steady_clock::now() < end)
+		;
+}
+
+template <typename Queue>
+void Run(const Options& options, const int threadCount, Queue& queue)
+{
+	std::atomic_int processed { 0 };
+
+	std::vector<std::thread> workers;
+	for (int i = 0; i < threadCount; ++i)
+		workers.emplace_back([&] {
+			while (queue.Pop())
+			{
+				Spin(options.work);
+				++processed;
+				queue.NotifyChanged();
+			}
+		});
+
+	const auto capacity   = GetCapacity(threadCount);
+	const auto canEnqueue = [&] {
+		return queue.GetSize() < capacity;
+	};
+
+	for (int i = 0; i < options.itemCount; ++i)
+	{
+		if (!canEnqueue())
+			queue.WaitUntil(canEnqueue);
+		queue.Push(i);
+	}
+
+	queue.Close();
+	for (auto& worker : workers)
+		worker.join();
+
+	if (processed != options.itemCount)
+		PLOGE << QString("queue: %1 of %2 items processed").arg(processed.load()).arg(options.itemCount);
+}
+
+} // namespace
+
+namespace HomeCompa::flibench
+{
+
+void RunQueue(const Options& options)
+{
+	PLOGI << QString("queue: %1 items, %2 us of work each, best of %3").arg(options.itemCount).arg(options.work.count()).arg(options.iterations);
+
+	for (const auto threadCount : options.threads)
+	{
+		const auto legacy = Measure(options.iterations, [&] {
+			LegacyQueue<int> queue(threadCount);
+			Run(options, threadCount, queue);
+		});
+		const auto current = Measure(options.iterations, [&] {
+			FliLib::WorkQueue<int> queue(GetCapacity(threadCount));
+			Run(options, threadCount, queue);
+		});
+
+		PLOGI << QString("queue, %1 workers: legacy %2 ms, work queue %3 ms, x%4").arg(threadCount).arg(legacy, 0, 'f', 2).arg(current, 0, 'f', 2).arg(legacy / current, 0, 'f', 2);
+	}
+}
+
+} // namespace HomeCompa::flibench
@@ -0,0 +1,12 @@
+AddTarget(flibench	app_console
+	PROJECT_GROUP    Tool
+	SOURCE_DIRECTORY "${CMAKE_CURRENT_LIST_DIR}"
+	SKIP_INSTALL
+	LINK_LIBRARIES
+		Qt${QT_MAJOR_VERSION}::Core
+		Qt${QT_MAJOR_VERSION}::Gui
+	LINK_TARGETS
+		lib
+		logging
+		util
+)
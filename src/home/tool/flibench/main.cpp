@@ -0,0 +1,141 @@
+#include <thread>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QStandardPaths>
+
+#include <plog/Appenders/ConsoleAppender.h>
+
+#include "logging/LogAppender.h"
+#include "logging/init.h"
+#include "util/LogConsoleFormatter.h"
+
+#include "Benchmark.h"
+#include "log.h"
+
+#include "config/version.h"
+
+using namespace HomeCompa::flibench;
+using namespace HomeCompa;
+
+namespace
+{
+
+constexpr auto APP_ID = "flibench";
+
+constexpr auto ITERATIONS_OPTION_NAME = "iterations";
+constexpr auto SIZE_OPTION_NAME       = "size";
+constexpr auto THREADS_OPTION_NAME    = "threads";
+constexpr auto ITEMS_OPTION_NAME      = "items";
+constexpr auto WORK_OPTION_NAME       = "work";
+constexpr auto PIXELS                 = "pixels";
+constexpr auto QUEUE                  = "queue";
+
+constexpr auto MAX_DEFAULT_THREAD_COUNT = 64;
+
+int ToInt(const QCommandLineParser& parser, const char* key, const int defaultValue)
+{
+	bool       ok    = false;
+	const auto value = parser.value(key).toInt(&ok);
+	return ok && value > 0 ? value : defaultValue;
+}
+
+std::vector<int> GetThreads(const QCommandLineParser& parser)
+{
+	std::vector<int> result;
+	for (const auto& item : parser.value(THREADS_OPTION_NAME).split(',', Qt::SkipEmptyParts))
+		if (const auto value = item.trimmed().toInt(); value > 0)
+			result.push_back(value);
+
+	if (!result.empty())
+		return result;
+
+	const auto maxThreadCount = std::max(static_cast<int>(std::thread::hardware_concurrency()), MAX_DEFAULT_THREAD_COUNT);
+	for (int threadCount = 1; threadCount < maxThreadCount; threadCount *= 2)
+		result.push_back(threadCount);
+	result.push_back(maxThreadCount);
+
+	return result;
+}
+
+void go(const int argc, char* argv[])
+{
+	const QCoreApplication app(argc, argv);
+	QCoreApplication::setApplicationName(APP_ID);
+	QCoreApplication::setApplicationVersion(PRODUCT_VERSION);
+
+	Options options;
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription(QString("%1 measures fb2cut hot paths against their baseline implementations").arg(APP_ID));
+	parser.addHelpOption();
+	parser.addVersionOption();
+	parser.addPositionalArgument("benchmarks", QString("Benchmarks to run: %1, %2. All by default").arg(PIXELS, QUEUE), "[benchmarks...]");
+	parser.addOptions(
+		{
+			{ { "i", ITERATIONS_OPTION_NAME }, "Number of runs, the best one is reported", QString("count [%1]").arg(options.iterations) },
+			{ SIZE_OPTION_NAME, "Test image side", QString("pixels [%1]").arg(options.size.width()) },
+			{ THREADS_OPTION_NAME, "Comma separated queue worker counts, powers of two up to 64 or CPU threads, whichever is greater, by default", "list" },
+			{ ITEMS_OPTION_NAME, "Number of items passed through the queue", QString("count [%1]").arg(options.itemCount) },
+			{ WORK_OPTION_NAME, "Time spent by a worker on each queue item, microseconds", QString("time [%1]").arg(options.work.count()) },
+	});
+	parser.process(app);
+
+	options.iterations = ToInt(parser, ITERATIONS_OPTION_NAME, options.iterations);
+	const auto side    = ToInt(parser, SIZE_OPTION_NAME, options.size.width());
+	options.size       = { side, side };
+	options.threads    = GetThreads(parser);
+	options.itemCount  = ToInt(parser, ITEMS_OPTION_NAME, options.itemCount);
+	options.work       = std::chrono::microseconds { ToInt(parser, WORK_OPTION_NAME, static_cast<int>(options.work.count())) };
+
+	const auto benchmarks = parser.positionalArguments();
+	const auto isEnabled  = [&](const char* name) {
+		return benchmarks.isEmpty() || benchmarks.contains(name, Qt::CaseInsensitive);
+	};
+
+	if (isEnabled(PIXELS))
+		RunPixelKernels(options);
+	if (isEnabled(QUEUE))
+		RunQueue(options);
+}
+
+} // namespace
+
+namespace HomeCompa::flibench
+{
+
+QString FormatComparison(const QString& name, const double baseline, const double value, const double megabytes)
+{
+	return QString("%1: baseline %2 ms (%3 MB/s), optimized %4 ms (%5 MB/s), x%6")
+	    .arg(name)
+	    .arg(baseline, 0, 'f', 2)
+	    .arg(megabytes * 1000 / baseline, 0, 'f', 0)
+	    .arg(value, 0, 'f', 2)
+	    .arg(megabytes * 1000 / value, 0, 'f', 0)
+	    .arg(baseline / value, 0, 'f', 2);
+}
+
+} // namespace HomeCompa::flibench
+
+int main(const int argc, char* argv[])
+{
+	Log::LoggingInitializer                          logging(QString("%1/%2.%3.log").arg(QStandardPaths::writableLocation(QStandardPaths::TempLocation), COMPANY_ID, APP_ID));
+	plog::ConsoleAppender<Util::LogConsoleFormatter> consoleAppender;
+	Log::LogAppender                                 logConsoleAppender(&consoleAppender);
+
+	try
+	{
+		go(argc, argv);
+		return 0;
+	}
+	catch (const std::exception& ex)
+	{
+		PLOGE << ex.what();
+	}
+	catch (...)
+	{
+		PLOGE << "Unknown error";
+	}
+
+	return 1;
+}
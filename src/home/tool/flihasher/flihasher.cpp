@@ -12,6 +12,8 @@
 
 #include "fnd/StrUtil.h"
 
+#include "lib/ArchiveManifest.h"
+#include "lib/Hash.h"
 #include "lib/dump/Factory.h"
 #include "lib/util.h"
 #include "logging/LogAppender.h"
@@ -26,7 +28,6 @@
 
 #include "Constant.h"
 #include "log.h"
-#include "zip.h"
 
 #include "config/version.h"
 
@@ -87,7 +88,7 @@ void ProcessArchive(const Options& options, const QString& filePath, Progress& p
 
 	XmlWriter  writer(output);
 	const auto booksGuard = writer.Guard("books");
-	booksGuard->WriteAttribute("source", options.sourceLib);
+	booksGuard->WriteAttribute("source", options.sourceLib).WriteAttribute(HASH_ALGORITHM, HASH_MD5);
 
 	PLOGV << "writing results";
 	for (const auto& file : bookHashItems)
@@ -158,10 +159,7 @@ int run(const Options& options)
 		const auto archives = GetArchives(options.args);
 
 		PLOGD << "Total file count calculation";
-		const auto totalFileCount = std::accumulate(archives.cbegin(), archives.cend(), size_t { 0 }, [](const auto init, const auto& item) {
-			const Zip zip(item);
-			return init + zip.GetFileNameList().size();
-		});
+		const auto totalFileCount = FliLib::GetFileCount(archives);
 		PLOGI << "Total file count: " << totalFileCount;
 
 		Progress progress(totalFileCount, "parsing");
@@ -8,6 +8,7 @@ AddTarget(flimager	app_console
 		Qt${QT_MAJOR_VERSION}::Gui
 	LINK_TARGETS
 		fljxl
+		lib
 		logging
 		util
 		zip
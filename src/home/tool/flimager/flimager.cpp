@@ -1,4 +1,5 @@
-﻿#include <mutex>
+﻿#include <chrono>
+#include <mutex>
 #include <queue>
 #include <ranges>
 #include <thread>
@@ -8,6 +9,7 @@
 #include <QCoreApplication>
 #include <QDir>
 #include <QGuiApplication>
+#include <QImageReader>
 #include <QPixmap>
 #include <QSize>
 #include <QStandardPaths>
@@ -20,6 +22,12 @@
 #include "fnd/ScopedCall.h"
 
 #include "jxl/jxl.h"
+#include "lib/ArchiveManifest.h"
+#include "lib/ArchiveReader.h"
+#include "lib/ArchiveWriter.h"
+#include "lib/ImageReader.h"
+#include "lib/JpegTranscoder.h"
+#include "lib/PixelKernels.h"
 #include "logging/LogAppender.h"
 #include "logging/init.h"
 #include "util/ImageUtil.h"
@@ -44,6 +52,7 @@ constexpr auto MAX_SIZE_OPTION_NAME               = "max-size";
 constexpr auto MAX_WIDTH_OPTION_NAME              = "max-width";
 constexpr auto MAX_HEIGHT_OPTION_NAME             = "max-height";
 constexpr auto GRAYSCALE_OPTION_NAME              = "grayscale";
+constexpr auto JPEG_TRANSCODE_OPTION_NAME         = "jpeg-transcode";
 constexpr auto MAX_THREAD_COUNT_OPTION_NAME       = "threads";
 constexpr auto FOLDER                             = "folder";
 constexpr auto QUALITY                            = "quality [-1]";
@@ -61,12 +70,33 @@ struct Settings
 	QString     format { JXL::FORMAT };
 	int         quality { -1 };
 	bool        grayScale { false };
+	bool        jpegTranscode { false };
 	QSize       size { std::numeric_limits<int>::max(), std::numeric_limits<int>::max() };
 	size_t      maxThreadCount { static_cast<size_t>(std::thread::hardware_concurrency()) };
 	int         totalImageCount { 0 };
 	QString     logFileName;
 };
 
+struct EncodeCounters
+{
+	std::atomic_int64_t transcoded { 0 };
+	std::atomic_int64_t transcodeTime { 0 };
+	std::atomic_int64_t encoded { 0 };
+	std::atomic_int64_t encodeTime { 0 };
+	std::atomic_int64_t fallback { 0 };
+};
+
+EncodeCounters& GetEncodeCounters()
+{
+	static EncodeCounters counters;
+	return counters;
+}
+
+int64_t GetElapsed(const std::chrono::steady_clock::time_point startTime)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
 QByteArray Encode(const QImage& image, const char* format, const int quality)
 {
 	QByteArray result;
@@ -149,37 +179,37 @@ private:
 		if (QFile::exists(outputFileName) && !QFile::remove(outputFileName))
 			throw std::ios_base::failure(QString("Cannot remove %1").arg(outputFileName).toStdString());
 
-		auto recoded = Recode(m_settings.inputDir + fileName);
-		Write(outputFileName, std::move(recoded));
-	}
-
-	void Write(const QString& outputFileName, std::vector<std::tuple<QString, QByteArray, QDateTime>> data) const
-	{
-		PLOGI << "archive " << data.size() << " images to " << outputFileName;
-
 		if (const auto dstDir = QFileInfo(outputFileName).dir(); !dstDir.exists() && !dstDir.mkpath("."))
 			throw std::ios_base::failure(QString("Cannot create %1").arg(dstDir.path()).toStdString());
 
-		auto zipFiles = Zip::CreateZipFileController();
-		for (auto&& [fileName, body, time] : data)
-			zipFiles->AddFile(std::move(fileName), body, std::move(time));
+		FliLib::ArchiveWriter writer(outputFileName, Zip::Format::Zip, true);
+		writer.SetProperty(Zip::PropertyId::ThreadsCount, static_cast<qulonglong>(m_settings.maxThreadCount));
+
+		Recode(m_settings.inputDir + fileName, writer);
+
+		const auto isIncompressible = writer.IsIncompressible();
+		writer.SetProperty(Zip::PropertyId::CompressionLevel, QVariant::fromValue(isIncompressible ? Zip::CompressionLevel::None : Zip::CompressionLevel::Ultra));
 
-		Zip zip(outputFileName, Zip::Format::Zip);
-		zip.SetProperty(Zip::PropertyId::CompressionLevel, QVariant::fromValue(Zip::CompressionLevel::Ultra));
-		zip.SetProperty(Zip::PropertyId::ThreadsCount, static_cast<qulonglong>(m_settings.maxThreadCount));
-		zip.Write(*zipFiles);
+		PLOGI << "archive " << writer.GetCount() << " images to " << outputFileName << ", " << writer.GetIncompressibleSize() << " of " << writer.GetSize() << " bytes incompressible, "
+			  << (isIncompressible ? "stored" : "compressed");
+		const auto startTime = std::chrono::steady_clock::now();
+		if (!writer.Finalize())
+		{
+			m_hasError = true;
+			PLOGE << "Cannot write " << outputFileName;
+			return;
+		}
 
-		PLOGI << "archive " << outputFileName << " done";
+		PLOGI << "archive " << outputFileName << " done, " << QFileInfo(outputFileName).size() << " bytes written in "
+			  << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count() << " ms";
 	}
 
-	std::vector<std::tuple<QString, QByteArray, QDateTime>> Recode(const QString& fileName) const
+	void Recode(const QString& fileName, FliLib::ArchiveWriter& writer) const
 	{
 		const QFileInfo fileInfo(fileName);
 
-		std::vector<std::tuple<QString, QByteArray, QDateTime>> result;
-		const Zip                                               zip(fileInfo.filePath());
-		for (auto imageFile : zip.GetFileNameList())
-		{
+		const Zip zip(fileInfo.filePath());
+		FliLib::ForEachEntry(zip, [&](QString imageFile, const QByteArray& imageBody, QDateTime time) {
 			const ScopedCall fileCountGuard([&, percents = m_imageCount * 100 / m_settings.totalImageCount]() {
 				int        imageCount      = ++m_imageCount;
 				const auto currentPercents = imageCount * 100 / m_settings.totalImageCount;
@@ -189,33 +219,52 @@ private:
 				}
 			});
 
-			const auto imageBody = zip.Read(imageFile)->GetStream().readAll();
 			if (auto recoded = Recode(imageBody); !recoded.isEmpty())
 			{
-				auto time = zip.GetFileTime(imageFile);
-				result.emplace_back(std::move(imageFile), std::move(recoded), std::move(time));
+				writer.Append(std::move(imageFile), std::move(recoded), std::move(time));
 			}
 			else
 			{
 				m_hasError = true;
 				PLOGE << "Cannot recode " << fileInfo.fileName() << "/" << imageFile;
 			}
-		}
-
-		return result;
+		});
 	}
 
 	QByteArray Recode(const QByteArray& src) const
 	{
-		auto image = Util::Decode(src).toImage();
+		auto& counters = GetEncodeCounters();
+		if (m_settings.jpegTranscode && !m_settings.grayScale && m_encoder == &JXL::Encode && FliLib::IsJpeg(src) && FitsSize(src))
+		{
+			const auto startTime = std::chrono::steady_clock::now();
+			auto       result    = FliLib::TranscodeJpeg(src);
+			counters.transcodeTime += GetElapsed(startTime);
+			if (!result.isEmpty())
+			{
+				++counters.transcoded;
+				return result;
+			}
+
+			++counters.fallback;
+			PLOGW << "jpeg transcoding failed, encoding pixels";
+		}
+
+		const auto       startTime = std::chrono::steady_clock::now();
+		const ScopedCall encodeGuard([&] {
+			++counters.encoded;
+			counters.encodeTime += GetElapsed(startTime);
+		});
+
+		auto image = ReadImage(src);
 		if (image.isNull())
 			return {};
 
 		if (m_settings.grayScale)
-			image.convertTo(QImage::Format::Format_Grayscale8);
+			image = FliLib::ToGrayscale(std::move(image));
 
 		if (image.pixelFormat().colorModel() != QPixelFormat::Grayscale)
-			image = Util::HasAlpha(image, src.constData());
+			if (image = FliLib::DropOpaqueAlpha(std::move(image)); image.hasAlphaChannel())
+				image = Util::HasAlpha(image, src.constData());
 
 		const bool hasAlpha = image.pixelFormat().alphaUsage() == QPixelFormat::UsesAlpha;
 		if (image.width() > m_settings.size.width() || image.height() > m_settings.size.height())
@@ -225,6 +274,30 @@ private:
 		return m_encoder(image, m_settings.quality);
 	}
 
+	bool FitsSize(const QByteArray& src) const
+	{
+		QBuffer buffer;
+		buffer.setData(src);
+		buffer.open(QIODevice::ReadOnly);
+
+		const auto size = QImageReader(&buffer).size();
+		return size.isValid() && size.width() <= m_settings.size.width() && size.height() <= m_settings.size.height();
+	}
+
+	QImage ReadImage(const QByteArray& src) const
+	{
+		QBuffer buffer;
+		buffer.setData(src);
+		buffer.open(QIODevice::ReadOnly);
+
+		QImageReader imageReader(&buffer);
+		FliLib::SetScaledSize(imageReader, m_settings.size);
+		if (auto image = imageReader.read(); !image.isNull())
+			return image;
+
+		return Util::Decode(src).toImage();
+	}
+
 private:
 	const Settings&   m_settings;
 	std::mutex&       m_queueGuard;
@@ -254,6 +327,14 @@ bool ProcessArchives(const Settings& settings)
 			workers.emplace_back(std::make_unique<Worker>(settings, queueGuard, queue, hasError, imageCount));
 	}
 
+	const auto& counters = GetEncodeCounters();
+	PLOGI << QString("jpeg transcoded: %1 in %2 ms, pixels encoded: %3 in %4 ms, transcoding fallbacks: %5")
+				 .arg(counters.transcoded.load())
+				 .arg(counters.transcodeTime.load())
+				 .arg(counters.encoded.load())
+				 .arg(counters.encodeTime.load())
+				 .arg(counters.fallback.load());
+
 	return hasError;
 }
 
@@ -284,11 +365,11 @@ void GetArchives(Settings& settings, const QStringList& wildCards)
 		});
 
 	PLOGD << "Total image count calculation";
-	settings.totalImageCount = std::accumulate(settings.inputFiles.cbegin(), settings.inputFiles.cend(), settings.totalImageCount, [&](const auto init, const QString& file) {
-		const Zip zip(settings.inputDir + file);
-		return init + zip.GetFileNameList().size();
-	});
+	settings.totalImageCount += static_cast<int>(FliLib::GetFileCount(settings.inputFiles | std::views::transform([&](const QString& file) {
+																			return settings.inputDir + file;
+																		}) | std::ranges::to<QStringList>()));
 	PLOGI << "Total image count: " << settings.totalImageCount;
+	PLOGI << "Pixel kernels: " << FliLib::GetPixelKernelsIsa();
 }
 
 Settings ProcessCommandLine(const QCoreApplication& app)
@@ -309,6 +390,7 @@ Settings ProcessCommandLine(const QCoreApplication& app)
 			{ MAX_HEIGHT_OPTION_NAME, "Maximum images height", SIZE },
 			{ { "s", MAX_SIZE_OPTION_NAME }, "Maximum image size", SIZE },
 			{ { "g", GRAYSCALE_OPTION_NAME }, "Convert all images to grayscale" },
+			{ JPEG_TRANSCODE_OPTION_NAME, "Recompress jpeg images fitting the maximum size to jpeg xl losslessly, without decoding pixels" },
 			{ { "t", MAX_THREAD_COUNT_OPTION_NAME }, "Maximum number of CPU threads", QString(THREADS).arg(settings.maxThreadCount) },
     }
 	);
@@ -341,7 +423,8 @@ Settings ProcessCommandLine(const QCoreApplication& app)
 		parser.showHelp();
 	}
 
-	settings.grayScale = parser.isSet(GRAYSCALE_OPTION_NAME);
+	settings.grayScale     = parser.isSet(GRAYSCALE_OPTION_NAME);
+	settings.jpegTranscode = parser.isSet(JPEG_TRANSCODE_OPTION_NAME);
 
 	if (auto value = parser.value(FORMAT); !value.isEmpty())
 		settings.format = std::move(value);
@@ -19,6 +19,8 @@
 #include "fnd/StrUtil.h"
 #include "fnd/try.h"
 
+#include "lib/ArchiveReader.h"
+#include "lib/ArchiveWriter.h"
 #include "lib/UniqueFile.h"
 #include "lib/archive.h"
 #include "lib/book.h"
@@ -129,8 +131,8 @@ class AnnotationCollector final : virtual public IAnnotationCollector
 		NON_COPY_MOVABLE(Data)
 
 	public:
-		Data(IZipFileController& zipFiles, QString folder)
-			: m_zipFiles { zipFiles }
+		Data(FliLib::ArchiveWriter& archive, QString folder)
+			: m_archive { archive }
 			, m_folder { std::move(folder) }
 		{
 			(*m_folderGuard)->WriteAttribute("name", m_folder);
@@ -142,7 +144,7 @@ class AnnotationCollector final : virtual public IAnnotationCollector
 			m_writer.reset();
 			m_stream.reset();
 			if (m_found)
-				m_zipFiles.AddFile(std::move(m_folder), m_data);
+				m_archive.Append(std::move(m_folder), std::move(m_data));
 		}
 
 		void Add(const QString& file, const QStringList& annotation)
@@ -167,8 +169,8 @@ class AnnotationCollector final : virtual public IAnnotationCollector
 		}
 
 	private:
-		IZipFileController& m_zipFiles;
-		QString             m_folder;
+		FliLib::ArchiveWriter& m_archive;
+		QString                m_folder;
 
 		QByteArray                                     m_data;
 		std::unique_ptr<QIODevice>                     m_stream { CreateStream(m_data) };
@@ -185,7 +187,7 @@ public:
 	}
 
 	explicit AnnotationCollector(const std::filesystem::path& outputFolder)
-		: m_outputFolder { outputFolder }
+		: m_archive { CreateArchive(outputFolder) }
 	{
 	}
 
@@ -193,13 +195,18 @@ public:
 	{
 		PLOGI << "archive annotations";
 		m_data.reset();
+		m_archive->Finalize();
+	}
 
-		const auto zipFileName = Platform::PathToString(m_outputFolder / Inpx::ANNOTATIONS);
+private:
+	static std::unique_ptr<FliLib::ArchiveWriter> CreateArchive(const std::filesystem::path& outputFolder)
+	{
+		const auto zipFileName = Platform::PathToString(outputFolder / Inpx::ANNOTATIONS);
 		QFile::remove(zipFileName);
-		Zip zip(zipFileName, ZipDetails::Format::SevenZip);
-		zip.SetProperty(ZipDetails::PropertyId::SolidArchive, false);
-		zip.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
-		zip.Write(*m_zipFiles);
+		auto archive = std::make_unique<FliLib::ArchiveWriter>(zipFileName, ZipDetails::Format::SevenZip);
+		archive->SetProperty(ZipDetails::PropertyId::SolidArchive, false);
+		archive->SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
+		return archive;
 	}
 
 private: // IAnnotationCollector
@@ -214,15 +221,14 @@ private: // IAnnotationCollector
 			return;
 
 		if (!m_data)
-			m_data = std::make_unique<Data>(*m_zipFiles, folder);
+			m_data = std::make_unique<Data>(*m_archive, folder);
 
 		m_data->Add(file, annotation);
 	}
 
 private:
-	const std::filesystem::path&        m_outputFolder;
-	std::shared_ptr<IZipFileController> m_zipFiles { Zip::CreateZipFileController() };
-	std::unique_ptr<Data>               m_data;
+	std::unique_ptr<FliLib::ArchiveWriter> m_archive;
+	std::unique_ptr<Data>                  m_data;
 };
 
 class FileHashParser final : Util::HashParser::IObserver
@@ -425,18 +431,16 @@ private:
 	ParseStorage&          m_parseStorage;
 };
 
-FileInfo GetFileHash(const Zip& zip, const QString& fileName)
+FileInfo GetFileHash(const QByteArray& fileData)
 {
-	const auto fileData = zip.Read(fileName)->GetStream().readAll();
-
 	QCryptographicHash hash(QCryptographicHash::Algorithm::Md5);
 	hash.addData(fileData);
 	return { hash.result().toHex(), fileData.size() };
 }
 
-Book* GetBookCustom(const QString& fileName, InpDataProvider& inpDataProvider, const Zip& zip, const QJsonObject& unIndexed)
+Book* GetBookCustom(const QString& fileName, const QByteArray& fileData, InpDataProvider& inpDataProvider, const QJsonObject& unIndexed)
 {
-	const auto [key, size] = GetFileHash(zip, fileName);
+	const auto [key, size] = GetFileHash(fileData);
 
 	const auto it = unIndexed.constFind(key);
 	if (it == unIndexed.constEnd())
@@ -680,9 +684,9 @@ std::optional<Book> ParseZip(
 	return ParseFb2(parserName, folder, *subZip, *it, zipDateTime, isDeleted, fileInfo.completeBaseName(), fileInfo.suffix());
 }
 
-Book* ParseBook(const QString& fileName, InpDataProvider& inpDataProvider, const QString& folder, const Zip& zip, const QDateTime& zipDateTime, const bool isDeleted)
+Book* ParseBook(const QString& fileName, const QByteArray& fileData, InpDataProvider& inpDataProvider, const QString& folder, const Zip& zip, const QDateTime& zipDateTime, const bool isDeleted)
 {
-	const auto hash = GetFileHash(zip, fileName).hash;
+	const auto hash = GetFileHash(fileData).hash;
 
 	if (auto book = inpDataProvider.GetBook(hash))
 		return book;
@@ -729,8 +733,8 @@ void CreateInpx(const Settings& settings, const Archives& archives, InpDataProvi
 		return item.level;
 	};
 
-	auto      zipFileController = Zip::CreateZipFileController();
-	QDateTime maxTime;
+	FliLib::ArchiveWriter inpx(Platform::PathToString(settings.inpxPath), ZipDetails::Format::Zip);
+	QDateTime             maxTime;
 
 	size_t totalCounter = 0;
 
@@ -738,16 +742,17 @@ void CreateInpx(const Settings& settings, const Archives& archives, InpDataProvi
 													return std::make_pair(QFileInfo(item.filePath), item.sourceLib);
 												}))
 	{
-		QByteArray file;
-		Zip        zip(zipFileInfo.filePath());
-		const auto bookFiles = zip.GetFileNameList();
-		const auto folder    = zipFileInfo.fileName();
+		QByteArray            file;
+		Zip                   zip(zipFileInfo.filePath());
+		FliLib::ArchiveReader reader(zip);
+		const auto            folder = zipFileInfo.fileName();
 
-		PLOGV << folder << ", files count: " << bookFiles.size();
+		PLOGV << folder << ", files count: " << reader.GetCount();
 		size_t counter = 0;
 
-		for (const auto& bookFile : bookFiles)
+		while (reader.Next())
 		{
+			const auto& bookFile = reader.GetFileName();
 			auto* book = inpDataProvider.GetBook({ folder, bookFile });
 			if (book)
 			{
@@ -763,10 +768,11 @@ void CreateInpx(const Settings& settings, const Archives& archives, InpDataProvi
 				}
 				else
 				{
-					book = GetBookCustom(bookFile, inpDataProvider, zip, unIndexed);
+					const auto bookData = reader.Read();
+					book                = GetBookCustom(bookFile, bookData, inpDataProvider, unIndexed);
 					if (!book)
 					{
-						book = ParseBook(bookFile, inpDataProvider, folder, zip, zipFileInfo.birthTime(), settings.isDeleted);
+						book = ParseBook(bookFile, bookData, inpDataProvider, folder, zip, zipFileInfo.birthTime(), settings.isDeleted);
 						if (!book)
 						{
 							PLOGW << zipFileInfo.filePath() << "/" << bookFile << " not found";
@@ -825,16 +831,16 @@ void CreateInpx(const Settings& settings, const Archives& archives, InpDataProvi
 			file << *book;
 			++counter;
 
-			maxTime = std::max(maxTime, zip.GetFileTime(bookFile));
+			maxTime = std::max(maxTime, reader.GetFileTime());
 		}
 
-		if (static_cast<qsizetype>(counter) == bookFiles.size())
+		if (counter == reader.GetCount())
 			PLOGV << folder << ", books added: " << counter;
 		else
-			PLOGW << folder << ", not all books added: " << counter << " out of " << bookFiles.size();
+			PLOGW << folder << ", not all books added: " << counter << " out of " << reader.GetCount();
 
 		if (!file.isEmpty())
-			zipFileController->AddFile(zipFileInfo.completeBaseName() + ".inp", file, QDateTime::currentDateTime());
+			inpx.Append(zipFileInfo.completeBaseName() + ".inp", std::move(file), QDateTime::currentDateTime());
 
 		totalCounter += counter;
 	}
@@ -860,15 +866,12 @@ void CreateInpx(const Settings& settings, const Archives& archives, InpDataProvi
 		return str;
 	}();
 
-	zipFileController->AddFile(Inpx::STRUCTURE_INFO, Inpx::INP_FIELDS_DESCRIPTION, QDateTime::currentDateTime());
-	zipFileController->AddFile(Inpx::VERSION_INFO, maxTime.toString("yyyyMMdd").toUtf8(), QDateTime::currentDateTime());
+	inpx.Append(Inpx::STRUCTURE_INFO, Inpx::INP_FIELDS_DESCRIPTION, QDateTime::currentDateTime());
+	inpx.Append(Inpx::VERSION_INFO, maxTime.toString("yyyyMMdd").toUtf8(), QDateTime::currentDateTime());
 	if (!collectionInfo.isEmpty())
-		zipFileController->AddFile(Inpx::COLLECTION_INFO, collectionInfo.toUtf8(), QDateTime::currentDateTime());
+		inpx.Append(Inpx::COLLECTION_INFO, collectionInfo.toUtf8(), QDateTime::currentDateTime());
 
-	{
-		Zip inpx(Platform::PathToString(settings.inpxPath), ZipDetails::Format::Zip);
-		inpx.Write(*zipFileController);
-	}
+	inpx.Finalize();
 }
 
 QByteArray CreateReviewAdditional(const InpDataProvider& inpDataProvider)
@@ -930,10 +933,9 @@ std::vector<std::tuple<QString, QByteArray>> CreateReviewData(const std::filesys
 					buffer.close();
 				}
 			);
-			Zip  zip(buffer, Zip::Format::Zip);
-			auto zipFiles = Zip::CreateZipFileController();
-			zipFiles->AddFile(Inpx::REVIEWS_ADDITIONAL_BOOKS_FILE_NAME, additional);
-			zip.Write(*zipFiles);
+			FliLib::ArchiveWriter writer(buffer, Zip::Format::Zip);
+			writer.Append(Inpx::REVIEWS_ADDITIONAL_BOOKS_FILE_NAME, additional);
+			writer.Finalize();
 		}
 
 		std::lock_guard lock(archivesGuard);
@@ -960,25 +962,6 @@ std::vector<std::tuple<QString, QByteArray>> CreateReviewData(const std::filesys
 			for (auto&& [folder, file, name, time, text] : data)
 				sorted[std::make_pair(std::move(folder), std::move(file))].try_emplace(std::make_pair(std::move(time), std::move(name)), std::move(text));
 
-			auto zipFiles = Zip::CreateZipFileController();
-			std::ranges::for_each(sorted, [&](auto& value) {
-				QJsonArray array;
-				for (auto& [id, text] : value.second)
-				{
-					text.prepend(' ');
-					text.append(' ');
-					array.append(
-						QJsonObject {
-							{ Inpx::NAME,         id.second.simplified() },
-							{ Inpx::TIME,                       id.first },
-							{ Inpx::TEXT, ReplaceTags(text).simplified() },
-                    }
-					);
-					++counter;
-				}
-				zipFiles->AddFile(QString("%1#%2").arg(value.first.first, value.first.second), QJsonDocument(array).toJson());
-			});
-
 			QByteArray zipBytes;
 			{
 				QBuffer          buffer(&zipBytes);
@@ -990,10 +973,27 @@ std::vector<std::tuple<QString, QByteArray>> CreateReviewData(const std::filesys
 						buffer.close();
 					}
 				);
-				Zip zip(buffer, Zip::Format::SevenZip);
-				zip.SetProperty(ZipDetails::PropertyId::SolidArchive, false);
-				zip.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
-				zip.Write(*zipFiles);
+				FliLib::ArchiveWriter writer(buffer, Zip::Format::SevenZip);
+				writer.SetProperty(ZipDetails::PropertyId::SolidArchive, false);
+				writer.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
+				std::ranges::for_each(sorted, [&](auto& value) {
+					QJsonArray array;
+					for (auto& [id, text] : value.second)
+					{
+						text.prepend(' ');
+						text.append(' ');
+						array.append(
+							QJsonObject {
+								{ Inpx::NAME,         id.second.simplified() },
+								{ Inpx::TIME,                       id.first },
+								{ Inpx::TEXT, ReplaceTags(text).simplified() },
+                        }
+						);
+						++counter;
+					}
+					writer.Append(QString("%1#%2").arg(value.first.first, value.first.second), QJsonDocument(array).toJson());
+				});
+				writer.Finalize();
 			}
 
 			std::lock_guard lock(archivesGuard);
@@ -1077,7 +1077,11 @@ void CreateBookList(const std::filesystem::path& outputFolder, const InpDataProv
 		langs[book->lang].emplace_back(book, std::make_tuple(getSortedString(book->author), getSortedString(series.title), getSortedNum(series.serNo), getSortedString(book->title)));
 	}
 
-	auto zipFiles = Zip::CreateZipFileController();
+	const auto            contentsFile = outputFolder / Inpx::CONTENTS;
+	FliLib::ArchiveWriter writer(Platform::PathToString(contentsFile), Zip::Format::SevenZip);
+	writer.SetProperty(ZipDetails::PropertyId::SolidArchive, false);
+	writer.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
+
 	std::ranges::for_each(langs, [&](auto& value) {
 		QByteArray data;
 		std::ranges::sort(value.second, {}, [](const auto& item) {
@@ -1098,17 +1102,12 @@ void CreateBookList(const std::filesystem::path& outputFolder, const InpDataProv
 			                .toUtf8());
 		}
 
-		zipFiles->AddFile(value.first + ".txt", data);
+		writer.Append(value.first + ".txt", std::move(data));
 	});
 
 	PLOGI << "archive contents";
-	const auto contentsFile = outputFolder / Inpx::CONTENTS;
 	remove(contentsFile);
-
-	Zip zip(Platform::PathToString(contentsFile), Zip::Format::SevenZip);
-	zip.SetProperty(ZipDetails::PropertyId::SolidArchive, false);
-	zip.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
-	zip.Write(*zipFiles);
+	writer.Finalize();
 }
 
 void ProcessCompilations(const std::filesystem::path& outputFolder, const Archives& archives, const InpDataProvider& inpDataProvider, IAnnotationCollector& annotationCollector)
@@ -1185,12 +1184,10 @@ void ProcessCompilations(const std::filesystem::path& outputFolder, const Archiv
 	const auto contentsFile = outputFolder / Inpx::COMPILATIONS;
 	remove(contentsFile);
 
-	auto zipFiles = Zip::CreateZipFileController();
-	zipFiles->AddFile(Inpx::COMPILATIONS_JSON, data);
-
-	Zip zip(Platform::PathToString(contentsFile), Zip::Format::SevenZip);
-	zip.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
-	zip.Write(*zipFiles);
+	FliLib::ArchiveWriter writer(Platform::PathToString(contentsFile), Zip::Format::SevenZip);
+	writer.SetProperty(Zip::PropertyId::CompressionMethod, QVariant::fromValue(Zip::CompressionMethod::Ppmd));
+	writer.Append(Inpx::COMPILATIONS_JSON, data);
+	writer.Finalize();
 }
 
 void CreateReview(const std::filesystem::path& outputFolder, const InpDataProvider& inpDataProvider, const Replacement& replacement)
@@ -7,6 +7,7 @@ AddTarget(flistat	app_console
 		Qt${QT_MAJOR_VERSION}::Core
 	LINK_TARGETS
 		dbfactory
+		lib
 		logging
 		util
 )
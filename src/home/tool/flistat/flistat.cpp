@@ -8,7 +8,7 @@
 #include "database/interface/IDatabase.h"
 #include "database/interface/ITransaction.h"
 
-#include "database/factory/Factory.h"
+#include "lib/ImageStatisticsDatabase.h"
 #include "logging/LogAppender.h"
 #include "logging/init.h"
 #include "util/LogConsoleFormatter.h"
@@ -24,42 +24,20 @@ namespace
 
 constexpr auto APP_ID = "flistat";
 
-void CreateDatabaseSchema(DB::IDatabase& db)
-{
-	static constexpr const char* COMMANDS[] {
-		R"(
-CREATE TABLE Image (
-    Folder    VARCHAR (200) NOT NULL,
-    FileName  VARCHAR (255) NOT NULL,
-    ImageID   VARCHAR (255) NOT NULL,
-    FailInfo  VARCHAR (20),
-	IsCover   INTEGER       NOT NULL,
-    PixelType INTEGER,
-    Size      BIGINT,
-    Width     INTEGER,
-    Height    INTEGER,
-    Hash      VARCHAR (50)  NOT NULL
-)
-)",
-		"CREATE INDEX IX_Image_Hash ON Image (Hash)",
-		"CREATE INDEX IX_Image_Folder ON Image (Folder)",
-		"CREATE INDEX IX_Image_FileName ON Image (FileName)",
-	};
-
-	const auto tr = db.CreateTransaction();
-	for (const auto* command : COMMANDS)
-		tr->CreateCommand(command)->Execute();
-	tr->Commit();
-}
+constexpr auto HASH_ALGORITHM_HEADER = "#HASH_ALGORITHM|";
+constexpr auto HASH_ALGORITHM_MD5    = "md5";
 
-std::unique_ptr<DB::IDatabase> CreateDatabase(const std::string_view fileName)
+QString ReadHashAlgorithm(QFile& inp)
 {
-	const auto dbExists     = QFile(QString::fromStdString(fileName.data())).exists();
-	const auto dbParameters = std::format("path={};flag={}", fileName, dbExists ? "READWRITE" : "CREATE");
-	auto       db           = Create(DB::Factory::Impl::Sqlite, dbParameters);
-	if (!dbExists)
-		CreateDatabaseSchema(*db);
-	return db;
+	QString     result = HASH_ALGORITHM_MD5;
+	QTextStream stream(&inp);
+	QString     line;
+	while (stream.readLineInto(&line) && line.startsWith('#'))
+		if (line.startsWith(HASH_ALGORITHM_HEADER))
+			result = line.mid(QString(HASH_ALGORITHM_HEADER).size()).trimmed();
+
+	inp.seek(0);
+	return result;
 }
 
 template <std::integral T>
@@ -86,10 +64,13 @@ void go(const int argc, char* argv[])
 
 	const auto totalSize = inp.size();
 
-	const auto db = CreateDatabase(argv[1]);
+	const auto hashAlgorithm = ReadHashAlgorithm(inp);
+
+	const auto db = FliLib::CreateImageStatisticsDatabase(QString::fromLocal8Bit(argv[1]), hashAlgorithm);
+
 	const auto tr = db->CreateTransaction();
 	{
-		const auto command = tr->CreateCommand(R"(INSERT INTO Image (Folder, FileName, ImageID, FailInfo, IsCover, PixelType, Size, Width, Height, Hash) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?))");
+		const auto command = tr->CreateCommand(FliLib::INSERT_IMAGE_STATISTICS);
 
 		long long percents = 0;
 
@@ -99,7 +80,12 @@ void go(const int argc, char* argv[])
 		while (stream.readLineInto(&line))
 		{
 			if (line.startsWith('#'))
+			{
+				if (line.startsWith(HASH_ALGORITHM_HEADER))
+					if (const auto sectionHashAlgorithm = line.mid(QString(HASH_ALGORITHM_HEADER).size()).trimmed(); sectionHashAlgorithm != hashAlgorithm)
+						throw std::invalid_argument(std::format("{} mixes hash algorithms {} and {}", argv[2], hashAlgorithm.toStdString(), sectionHashAlgorithm.toStdString()));
 				continue;
+			}
 
 			const auto data = line.split('|');
 			if (data.size() != 10)
@@ -137,6 +123,8 @@ void go(const int argc, char* argv[])
 		}
 	}
 	tr->Commit();
+
+	FliLib::CreateImageStatisticsIndices(*db);
 }
 
 } // namespace